@@ -15,10 +15,9 @@
 // on an Apple MacBook Pro with Intel Core Duo processor.
 // Also built (with trivial changes) and tested under MSVC++ 6.0.
 // While it is meant to be easily ported to other environments,
-// it should NOT be considered portable, in that it relies heavily
-// on specific data sizes and struct packing to match the .WAV format.
-// It is meant for Intel byte ordering, and will almost certainly fail
-// if built for Motorola or PPC processors.
+// wave file headers and samples are read and written field by field,
+// in little-endian order, so do not depend on struct packing or on
+// the byte ordering of the host processor.
 //
 // This code is placed in the public domain for the benefit and
 // entertaiment of audio enthusiasts and hobbyists.  Any and all uses
@@ -28,41 +27,882 @@
 // includes are limited to just a few standard files
 #include <iostream>
 #include <fstream>
+#include <complex>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <stdint.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <sstream>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <map>
 // #include <assert.h>	// uncomment this line for MSVC++ 6.0
 
+// platform files needed to read binary data from standard input,
+// and to expand wildcards in file names
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <glob.h>
+#endif
+
 // include the toneBurst class for this project
 #include "toneBurst.h"
 
 using namespace std;
 
-// main entry point for waveform analyzer
-int main (int argc, char * const argv[])
+// read-ahead queue for streamed input, a ring of burst buffers
+// a reader thread fills the next bursts while the current one is analyzed
+class burstQueue
+{
+private:
+	// data members
+	istream &input;		// file or pipe being read
+	size_t burstSize;	// number of bytes per burst
+	long numBurst;		// number of bursts to read, then stop
+	vector< vector<char> > slots;	// ring of buffers, one burst each
+	size_t head;		// index of oldest filled slot
+	size_t count;		// number of filled slots
+	bool done;			// true once reader has stopped
+	mutex lock;
+	condition_variable filled;	// signals consumer, a slot was filled
+	condition_variable emptied;	// signals reader, a slot was released
+	thread reader;
+	
+	// method members
+	void run();			// reader thread body
+	
+public:
+	burstQueue(istream &theInput, size_t theSize, long theCount, long depth);
+	~burstQueue();		// destructor waits for reader to stop
+	const char *front();	// wait for next burst, null if input ran out
+	void pop();			// release oldest burst, so its slot can be refilled
+};
+
+// start reading ahead as soon as queue is constructed
+burstQueue::burstQueue(istream &theInput, size_t theSize, long theCount, long depth)
+	: input(theInput), burstSize(theSize), numBurst(theCount),
+	slots(depth, vector<char>(theSize)), head(0), count(0), done(false)
+{
+	reader = thread(&burstQueue::run, this);
+}
+
+// reader stops on its own after the last burst, or at end of input
+burstQueue::~burstQueue()
+{
+	reader.join();
+}
+
+// reader thread, fills free slots in order
+void burstQueue::run()
+{
+	for (long k = 0; k < numBurst; k++)
+	{
+		// wait for a free slot, then read into it without holding the lock
+		size_t tail = 0;
+		{
+			unique_lock<mutex> guard(lock);
+			while (count == slots.size()) {emptied.wait(guard);}
+			tail = (head + count) % slots.size();
+		}
+		vector<char> &slot = slots[tail];
+		input.read(&slot[0], burstSize);
+		if (input.gcount() != (streamsize)burstSize) {break;}
+		
+		lock_guard<mutex> guard(lock);
+		count++;
+		filled.notify_one();
+	}
+	
+	// no more bursts will arrive
+	lock_guard<mutex> guard(lock);
+	done = true;
+	filled.notify_one();
+}
+
+// wait for the oldest filled slot
+const char *burstQueue::front()
+{
+	unique_lock<mutex> guard(lock);
+	while ((count == 0) && !done) {filled.wait(guard);}
+	return count ? &slots[head][0] : 0;
+}
+
+// release the oldest slot for reuse
+void burstQueue::pop()
+{
+	lock_guard<mutex> guard(lock);
+	head = (head + 1) % slots.size();
+	count--;
+	emptied.notify_one();
+}
+
+// stages of a run, timed separately for --stats
+enum runStage
+{
+	STAGE_HEADER,		// reading and checking wave file headers
+	STAGE_DELAY,		// skipping or searching for the first burst
+	STAGE_READ,			// reading or mapping sound data
+	STAGE_ANALYZE,		// matched filter, summed over all threads
+	STAGE_OUTPUT,		// formatting and writing results
+	NUM_STAGES
+};
+
+// optional timers and counters for a whole run
+// when not enabled, every method returns at once without reading the clock
+// safe to update from many threads
+class runStats
+{
+private:
+	// data members
+	bool enabled;		// true if user asked for stats
+	const char *fname;	// stats file, or null for standard error
+	chrono::steady_clock::time_point begin;	// start of run
+	double seconds[NUM_STAGES];	// time spent in each stage
+	double bytes;		// sound data bytes consumed
+	vector<double> burstSeconds;	// analysis time for each burst
+	long cacheHits;		// bursts whose results came from the cache
+	long cacheMisses;	// bursts analyzed, then added to the cache
+	mutex lock;
+	
+public:
+	// method members
+	void enable(const char *theName);	// start collecting
+	double now();		// seconds since start of run, zero if not enabled
+	void add(runStage stage, double start);	// add time since start to stage
+	void addBurst(double start);	// add time since start for one burst
+	void addBytes(double count);	// add sound data consumed
+	void addCache(bool hit);	// count one cache lookup
+	void show(long numThreads);	// show totals, if enabled
+	runStats();			// default constructor
+};
+
+// stats are off until asked for
+runStats::runStats()
+	: enabled(false), fname(0), begin(chrono::steady_clock::now()), bytes(0.0),
+	cacheHits(0), cacheMisses(0)
 {
-	// check object sizes while debugging
-	assert(sizeof(long) == 4);
-	assert(sizeof(short) == 2);
-	assert(sizeof(riffChunk) == 12);
-	assert(sizeof(fmtChunk) == 24);
-	assert(sizeof(dataChunk) == 8);
+	for (long k = 0; k < NUM_STAGES; k++) {seconds[k] = 0.0;}
+}
+
+// start collecting, reported to a file if named
+void runStats::enable(const char *theName)
+{
+	enabled = true;
+	fname = (theName && *theName) ? theName : 0;
+}
+
+// read the clock, only if enabled
+double runStats::now()
+{
+	if (!enabled) {return 0.0;}
+	return chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+}
+
+// add time since start to one stage
+void runStats::add(runStage stage, double start)
+{
+	if (!enabled) {return;}
+	double t = now();
+	lock_guard<mutex> guard(lock);
+	seconds[stage] += t - start;
+}
+
+// add time since start for one burst, which is also analysis time
+void runStats::addBurst(double start)
+{
+	if (!enabled) {return;}
+	double t = now();
+	lock_guard<mutex> guard(lock);
+	seconds[STAGE_ANALYZE] += t - start;
+	burstSeconds.push_back(t - start);
+}
+
+// count sound data consumed
+void runStats::addBytes(double count)
+{
+	if (!enabled) {return;}
+	lock_guard<mutex> guard(lock);
+	bytes += count;
+}
+
+// count one cache lookup, found or not
+void runStats::addCache(bool hit)
+{
+	if (!enabled) {return;}
+	lock_guard<mutex> guard(lock);
+	if (hit) {cacheHits++;}
+	else {cacheMisses++;}
+}
+
+// show totals and per-burst percentiles, one name and value per line
+// times are in seconds, except per-burst times in microseconds
+void runStats::show(long numThreads)
+{
+	if (!enabled) {return;}
+	static const char *names[NUM_STAGES] =
+		{"header", "delay", "read", "analyze", "output"};
+	double total = now();
+	ofstream file;
+	if (fname) {file.open(fname, ios::out);}
+	if (fname && !file)
+		{cerr << "Failed to open stats file: " << fname << endl;}
+	ostream &out = fname ? (ostream &)file : cerr;
+	
+	lock_guard<mutex> guard(lock);
+	out << "stat\tvalue";
+	for (long k = 0; k < NUM_STAGES; k++)
+		{out << '\n' << names[k] << "_s\t" << seconds[k];}
+	out << "\ntotal_s\t" << total
+		<< "\nthreads\t" << numThreads
+		<< "\nbytes\t" << bytes
+		<< "\nbytes_per_s\t" << ((total > 0.0) ? bytes / total : 0.0)
+		<< "\nbursts\t" << burstSeconds.size();
+	if (cacheHits || cacheMisses)
+	{
+		out << "\ncache_hits\t" << cacheHits
+			<< "\ncache_misses\t" << cacheMisses;
+	}
+	
+	// nearest rank percentiles
+	sort(burstSeconds.begin(), burstSeconds.end());
+	static const double ranks[4] = {50.0, 90.0, 99.0, 100.0};
+	static const char *rankNames[4] = {"p50", "p90", "p99", "max"};
+	for (long k = 0; k < 4 && !burstSeconds.empty(); k++)
+	{
+		size_t n = burstSeconds.size();
+		size_t i = size_t(ranks[k] / 100.0 * n + 0.999999);
+		if (i < 1) {i = 1;}
+		if (i > n) {i = n;}
+		out << "\nburst_" << rankNames[k] << "_us\t" << 1e6 * burstSeconds[i - 1];
+	}
+	out << endl;
+}
+
+// results of earlier runs, kept in a file and reused whenever the same
+// samples are analyzed the same way again
+// the file is read once when opened, and entries found in this run are
+// appended when saved, or the whole file is rewritten if its tail was cut off
+// safe to use from many threads
+//
+// file is little-endian, a 4 byte "TBK3" tag, then one entry after another
+//   content and params keys, each uint64
+//   counts of resp, bkg, harm, err, noise and gap values, each uint32
+//   resp, bkg and harm as real and imaginary float64 pairs, then err, noise
+//   and gap float64
+// "TBK1" files, without noise or gap, and "TBK2" files, without gap, are
+// still read, and rewritten when saved
+class resultCache
+{
+private:
+	// data members
+	string fname;		// cache file, empty if not used
+	bool clean;			// true if the file holds exactly the entries read
+	map<cacheKey, burstResult> entries;	// every result known
+	vector<cacheKey> added;	// results new in this run, in order
+	mutex lock;
 	
+	// method member
+	void putEntry(string &data, const cacheKey &key);	// format one entry
+	
+public:
+	// method members
+	bool open(const char *theName);	// read entries, false if not a cache
+	bool isOpen() const {return !fname.empty();}
+	bool find(const cacheKey &key, burstResult &result);	// false if new
+	void add(const cacheKey &key, const burstResult &result);	// keep result
+	bool save();		// write new entries, false if failed
+	resultCache();		// default constructor
+};
+
+// cache is unused until opened
+resultCache::resultCache()
+	: clean(false)
+{
+}
+
+// read every entry of an existing cache file
+// a missing or empty file is a new cache, written when saved
+bool resultCache::open(const char *theName)
+{
+	fname = theName;
+	clean = false;
+	ifstream in(theName, ios::in | ios::binary);
+	if (!in) {return true;}
+	ostringstream text;
+	text << in.rdbuf();
+	string data = text.str();
+	if (data.empty()) {return true;}
+	long version = 0;
+	if ((data.size() >= 4) && !memcmp(data.data(), "TBK", 3)) {version = data[3] - '0';}
+	if ((version < 1) || (version > 3)) {fname.clear(); return false;}
+	
+	// each version holds one more list of real values than the last
+	// stop at the first entry cut short, so it is rewritten when saved
+	size_t numLists = version + 3;
+	size_t pos = 4, head = 16 + 4 * numLists;
+	while (pos + head <= data.size())
+	{
+		const char *p = &data[pos];
+		cacheKey key = {getLE64(p), getLE64(p + 8)};
+		size_t counts[6] = {0, 0, 0, 0, 0, 0};
+		size_t length = head;
+		for (size_t k = 0; k < numLists; k++)
+		{
+			counts[k] = getLE32(p + 16 + 4 * k);
+			length += ((k < 3) ? 16 : 8) * counts[k];
+		}
+		if (pos + length > data.size()) {break;}
+		burstResult &result = entries[key];
+		vector< complex<double> > *parts[3] = {&result.resp, &result.bkg, &result.harm};
+		vector<double> *reals[3] = {&result.err, &result.noise, &result.gap};
+		p += head;
+		for (long k = 0; k < 3; k++)
+		{
+			parts[k]->resize(counts[k]);
+			for (size_t n = 0; n < counts[k]; n++, p += 16)
+				{(*parts[k])[n] = complex<double>(getLEdouble(p), getLEdouble(p + 8));}
+		}
+		for (long k = 0; k < 3; k++)
+		{
+			reals[k]->resize(counts[3 + k]);
+			for (size_t n = 0; n < counts[3 + k]; n++, p += 8) {(*reals[k])[n] = getLEdouble(p);}
+		}
+		pos += length;
+	}
+	clean = (version == 3) && (pos == data.size());
+	return true;
+}
+
+// copy results for this key, if known
+bool resultCache::find(const cacheKey &key, burstResult &result)
+{
+	lock_guard<mutex> guard(lock);
+	map<cacheKey, burstResult>::const_iterator it = entries.find(key);
+	if (it == entries.end()) {return false;}
+	result = it->second;
+	return true;
+}
+
+// keep results for this key, to be written when saved
+void resultCache::add(const cacheKey &key, const burstResult &result)
+{
+	lock_guard<mutex> guard(lock);
+	if (entries.insert(make_pair(key, result)).second) {added.push_back(key);}
+}
+
+// append one entry to data, in file layout
+void resultCache::putEntry(string &data, const cacheKey &key)
+{
+	const burstResult &result = entries[key];
+	const vector< complex<double> > *parts[3] = {&result.resp, &result.bkg, &result.harm};
+	const vector<double> *reals[3] = {&result.err, &result.noise, &result.gap};
+	size_t pos = data.size();
+	size_t length = 40;
+	for (long k = 0; k < 3; k++) {length += 16 * parts[k]->size() + 8 * reals[k]->size();}
+	data.resize(pos + length);
+	char *p = &data[pos];
+	putLE64(p, key.content);
+	putLE64(p + 8, key.params);
+	for (long k = 0; k < 3; k++)
+	{
+		putLE32(p + 16 + 4 * k, uint32_t(parts[k]->size()));
+		putLE32(p + 28 + 4 * k, uint32_t(reals[k]->size()));
+	}
+	p += 40;
+	for (long k = 0; k < 3; k++)
+	for (size_t n = 0; n < parts[k]->size(); n++, p += 16)
+	{
+		putLEdouble(p, (*parts[k])[n].real());
+		putLEdouble(p + 8, (*parts[k])[n].imag());
+	}
+	for (long k = 0; k < 3; k++)
+	for (size_t n = 0; n < reals[k]->size(); n++, p += 8) {putLEdouble(p, (*reals[k])[n]);}
+}
+
+// append entries new in this run, or rewrite the whole file if it was not
+// clean, so a run cut short never leaves a damaged tail behind
+bool resultCache::save()
+{
+	lock_guard<mutex> guard(lock);
+	if (fname.empty() || (clean && added.empty())) {return true;}
+	string data;
+	if (clean)
+	{
+		for (size_t k = 0; k < added.size(); k++) {putEntry(data, added[k]);}
+	}
+	else
+	{
+		data = "TBK3";
+		map<cacheKey, burstResult>::const_iterator it;
+		for (it = entries.begin(); it != entries.end(); ++it) {putEntry(data, it->first);}
+	}
+	ofstream out(fname.c_str(), ios::out | ios::binary | (clean ? ios::app : ios::trunc));
+	out.write(data.data(), data.size());
+	if (!out) {return false;}
+	added.clear();
+	clean = true;
+	return true;
+}
+
+// get value for an option flag, either attached (-j4) or next argument (-j 4)
+static const char *optionValue(int &argc, char * const *&argv)
+{
+	if (argv[1][2]) {return &argv[1][2];}
+	if (argc > 2) {argc--; argv++; return argv[1];}
+	return "";
+}
+
+// count planned bursts which are complete within the available sound data
+static long countReady(const toneBurst &myBurst, const vector<burstStep> &steps,
+	int64_t numData)
+{
+	long numReady = 0;
+	while ((numReady < (long)steps.size()) &&
+		(steps[numReady].offset + myBurst.getSpan() <= numData)) {numReady++;}
+	return numReady;
+}
+
+// analyze one burst, unless the cache already holds its results
+// frames point to interleaved sound data at the start of this burst
+static void analyzeCached(const toneBurst &myBurst, const burstStep &step,
+	const char *frames, burstResult &result, resultCache &cache, runStats &stats)
+{
+	cacheKey key;
+	if (cache.isOpen())
+	{
+		key = myBurst.getKey(step, frames);
+		bool hit = cache.find(key, result);
+		stats.addCache(hit);
+		if (hit) {return;}
+	}
+	myBurst.analyze(step, frames, result);
+	if (cache.isOpen()) {cache.add(key, result);}
+}
+
+// analyze the first numSteps planned bursts on a pool of worker threads
+// results go to the sink in plan order, as soon as each is ready
+static void analyzeBursts(const toneBurst &myBurst, const vector<burstStep> &steps,
+	long numSteps, const char *frames, long numThreads, resultSink &sink,
+	resultCache &cache, runStats &stats)
+{
+	vector<burstResult> results(numSteps);
+	vector<char> ready(numSteps, 0);
+	mutex readyLock;
+	condition_variable readySignal;
+	atomic<long> nextStep(0);
+	
+	// each worker claims the next unclaimed step until none remain
+	auto worker = [&]()
+	{
+		long k = 0;
+		while ((k = nextStep++) < numSteps)
+		{
+			double start = stats.now();
+			analyzeCached(myBurst, steps[k],
+				frames + size_t(myBurst.getFrameSize()) * steps[k].offset, results[k],
+				cache, stats);
+			stats.addBurst(start);
+			lock_guard<mutex> guard(readyLock);
+			ready[k] = 1;
+			readySignal.notify_one();
+		}
+	};
+	
+	// single thread needs no pool, just analyze in order
+	vector<thread> pool;
+	if (numThreads <= 1) {worker();}
+	else
+	{
+		for (long t = 0; t < numThreads; t++) {pool.push_back(thread(worker));}
+	}
+	
+	// show results in plan order, waiting for each in turn
+	for (long k = 0; k < numSteps; k++)
+	{
+		{
+			unique_lock<mutex> guard(readyLock);
+			while (!ready[k]) {readySignal.wait(guard);}
+		}
+		double start = stats.now();
+		sink.put(steps[k], results[k]);
+		stats.add(STAGE_OUTPUT, start);
+	}
+	stats.addBytes(double(myBurst.getFrameSize()) * myBurst.getSpan() * numSteps);
+	for (size_t t = 0; t < pool.size(); t++) {pool[t].join();}
+}
+
+// read and check wave file header, then set burst to match its sample format
+// returns zero if successful, or error code and problem text
+static int checkHeader(istream &in, waveHeader &myHeader, toneBurst &myBurst,
+	const char *&problem)
+{
+	if (!myHeader.read(in))
+	{
+		problem = "Failed to read header info from disk";
+		return -3;
+	}
+	sampleType type = myHeader.fmt.getType();
+	long numChan = myHeader.fmt.getChannels();
+	if ((type == SAMPLE_UNKNOWN) || (numChan < 1))
+	{
+		problem = "Unsupported sample format";
+		return -3;
+	}
+	myBurst.setFormat(type, numChan);
+	if (myHeader.fmt.getBlockAlign() != myBurst.getFrameSize())
+	{
+		problem = "Unsupported block alignment";
+		return -3;
+	}
+	
+	// bursts are timed at the file's own rate
+	// the delay is already counted in the file's samples, so it is kept as is
+	long rate = myHeader.fmt.getRate();
+	if (rate < 8000)
+	{
+		problem = "Unsupported sample rate";
+		return -3;
+	}
+	long theDelay = myBurst.delay;
+	myBurst.setRate(rate);
+	myBurst.delay = theDelay;
+	return 0;
+}
+
+// count whole frames of sound data in a mapped file
+// data chunk size may be zero or too large when written by a streaming recorder
+static int64_t countFrames(waveHeader &myHeader, uint64_t fileSize, bool raw,
+	long frameSize)
+{
+	uint64_t offset = raw ? 0 : myHeader.dataOffset;
+	uint64_t count = (fileSize > offset) ? fileSize - offset : 0;
+	uint64_t declared = raw ? 0 : myHeader.data.getSize();
+	if (declared && (declared < count)) {count = declared;}
+	return int64_t(count / frameSize);
+}
+
+// expand input file argument into a list of file names
+// @name reads names from a text file, one per line
+// wildcards are expanded here, where the platform supports it
+static bool expandNames(const char *fname, vector<string> &fnames)
+{
+	fnames.clear();
+	if (fname[0] == '@')
+	{
+		ifstream list(fname + 1);
+		if (!list) {return false;}
+		string line;
+		while (getline(list, line))
+		{
+			// tolerate DOS line endings and blank lines
+			if (!line.empty() && (line[line.size() - 1] == '\r'))
+				{line.erase(line.size() - 1);}
+			if (!line.empty()) {fnames.push_back(line);}
+		}
+		return true;
+	}
+#ifndef _WIN32
+	if (strpbrk(fname, "*?["))
+	{
+		glob_t found;
+		if (glob(fname, 0, 0, &found) != 0) {return false;}
+		for (size_t k = 0; k < found.gl_pathc; k++)
+			{fnames.push_back(found.gl_pathv[k]);}
+		globfree(&found);
+		return true;
+	}
+#endif
+	fnames.push_back(fname);
+	return true;
+}
+
+// analyze the current burst of a stream, then show its result
+// frames point to interleaved sound data at the start of this burst
+static void showBurst(toneBurst &myBurst, const char *frames, resultSink &sink,
+	resultCache &cache, runStats &stats)
+{
+	burstResult result;
+	burstStep theStep = myBurst.step();
+	double start = stats.now();
+	analyzeCached(myBurst, theStep, frames, result, cache, stats);
+	stats.addBurst(start);
+	start = stats.now();
+	sink.put(theStep, result);
+	stats.add(STAGE_OUTPUT, start);
+}
+
+// analyze many input files on a pool of worker threads, with one shared setup
+// each file is mapped and analyzed in turn by one worker, and its rows are
+// tagged with its name and written together once that file is done
+static int analyzeBatch(const toneBurst &myBurst, const vector<burstStep> &steps,
+	const vector<string> &fnames, long numThreads, bool raw, bool autoDelay,
+	sinkFormat format, ostream &out, ostream *noise, resultCache &cache,
+	runStats &stats)
+{
+	size_t numFiles = fnames.size();
+	atomic<size_t> nextFile(0);
+	atomic<int> status(0);
+	mutex outLock;
+	
+	// each worker claims the next unclaimed file until none remain
+	auto worker = [&]()
+	{
+		size_t k = 0;
+		while ((k = nextFile++) < numFiles)
+		{
+			const char *fname = fnames[k].c_str();
+			const char *problem = 0;
+			int code = 0;
+			double onset = -1.0;	// first burst, if found automatically
+			ostringstream rows, spectrum;
+			
+			// each file may have its own sample format
+			toneBurst fileBurst = myBurst;
+			waveHeader myHeader;
+			ifstream infile(fname, ios::in | ios::binary);
+			waveMap myMap;
+			double start = stats.now();
+			if (!infile)
+				{problem = "Failed to open input file"; code = -2;}
+			else if (!raw)
+				{code = checkHeader(infile, myHeader, fileBurst, problem);}
+			
+			// every file shares one plan and one heading,
+			// so they must share one rate and one channel count
+			if (!code && (fileBurst.getRate() != myBurst.getRate()))
+				{problem = "Sample rate differs from the first file"; code = -3;}
+			if (!code && (fileBurst.getChannels() != myBurst.getChannels()))
+				{problem = "Channel count differs from the first file"; code = -3;}
+			infile.close();
+			stats.add(STAGE_HEADER, start);
+			start = stats.now();
+			if (!code && !myMap.open(fname))
+				{problem = "Failed to map input file"; code = -2;}
+			stats.add(STAGE_READ, start);
+			resultSink fileSink(fileBurst, format, rows, fname);
+			if (noise) {fileSink.setNoise(&spectrum);}
+			if (!code)
+			{
+				const char *frames = myMap.data() + (raw ? 0 : size_t(myHeader.dataOffset));
+				int64_t numData = countFrames(myHeader, myMap.size(), raw,
+					fileBurst.getFrameSize());
+				
+				// skip to this file's first burst, if found automatically
+				if (autoDelay)
+				{
+					start = stats.now();
+					onset = fileBurst.findOnset(frames, numData);
+					stats.add(STAGE_DELAY, start);
+					int64_t skip = llround(onset);
+					if (onset < 0.0) {skip = numData;}
+					else {fileSink.setOnset(onset);}
+					frames += size_t(fileBurst.getFrameSize()) * skip;
+					numData -= skip;
+				}
+				long numReady = countReady(fileBurst, steps, numData);
+				analyzeBursts(fileBurst, steps, numReady, frames, 1, fileSink,
+					cache, stats);
+				if (numReady < (long)steps.size())
+					{problem = "Failed to read tone bursts from disk"; code = -4;}
+			}
+			start = stats.now();
+			fileSink.finish();
+			
+			// write this file all at once, so rows from files do not mix
+			lock_guard<mutex> guard(outLock);
+			string text = rows.str();
+			out.write(text.data(), text.size());
+			if (noise) {*noise << spectrum.str();}
+			stats.add(STAGE_OUTPUT, start);
+			
+			// onset goes to standard error, so result rows keep one layout
+			if (onset >= 0.0) {cerr << "Onset at " << onset << " frames: " << fname << endl;}
+			if (problem)
+			{
+				cerr << problem << ": " << fname << endl;
+				status = code;
+			}
+		}
+	};
+	
+	// bounded pool, never more workers than files
+	if ((size_t)numThreads > numFiles) {numThreads = (long)numFiles;}
+	vector<thread> pool;
+	for (long t = 0; t < numThreads; t++) {pool.push_back(thread(worker));}
+	for (size_t t = 0; t < pool.size(); t++) {pool[t].join();}
+	out.flush();
+	return status;
+}
+
+// analyze waveform as given on the command line, return zero if successful
+// stats are collected along the way, if asked for
+static int analyzeMain(int argc, char * const argv[], runStats &stats,
+	resultCache &cache, long &numThreads)
+{
 	// instantiate a tone burst object
 	toneBurst myBurst;
 
-	// containers for wave file header info
-	riffChunk myRiff;
-	fmtChunk myFmt;
-	dataChunk myData;
+	// container for wave file header info
+	waveHeader myHeader;
 	
 	// set default values
 	const char *fname = "infile.wav";
+	const char *exe = argv[0];
+	int numArgs = argc - 1;
+	bool mapped = true;		// map input file unless told otherwise
+	bool raw = false;		// input has a wave file header unless told otherwise
+	bool autoDelay = false;	// delay given by user unless told otherwise
+	long queueDepth = 2;	// number of bursts to read ahead when streaming
+	long rawChan = 2;		// number of channels in raw input
+	double stopFreq = 0.0;	// sweep end frequency, 0 for default
+	long numSteps = 0;		// number of bursts, 0 for default
+	long perDecade = 0;		// sweep steps per decade, 0 if not used
+	const char *listName = 0;	// frequency list file, or null
+	long numTones = 0;		// tones per burst, 0 for single tone bursts
+	bool logMode = false;	// tone bursts unless told otherwise
+	double sweepTime = SWEEP_SECONDS;	// log sweep length in seconds
+	long gateLen = 0;		// log sweep gate, 0 for default
+	long numHarm = 0;		// highest harmonic analyzed, 0 for none
+	precisionMode precision = PRECISION_DOUBLE;	// matched filter arithmetic
+	averageMode average = AVERAGE_SUM;	// how repetitions are combined
+	sinkFormat format = SINK_TEXT;	// how results are written
+	const char *outName = 0;	// results file, or null for console
+	const char *cacheName = 0;	// result cache file, or null for none
+	bool noiseSpec = false;	// gap noise spectrum, off unless asked for
+	const char *noiseName = 0;	// noise spectrum file, or null for console
+	
+	// check for leading option flags
+	while ((argc > 1) && (argv[1][0] == '-') && argv[1][1])
+	{
+		switch (argv[1][1])
+		{
+			case '-':	// long option, --stats[=file] or --noise[=file]
+				if ((strncmp(argv[1], "--stats", 7) && strncmp(argv[1], "--noise", 7)) ||
+					(argv[1][7] && (argv[1][7] != '=')))
+					{argc = 1; continue;}
+				if (argv[1][2] == 's')
+					{stats.enable(argv[1][7] ? &argv[1][8] : 0);}
+				else
+					{noiseSpec = true; noiseName = argv[1][7] ? &argv[1][8] : 0;}
+				break;
+				
+			case 's':	// user specified stream input
+				mapped = false;
+				break;
+				
+			case 'r':	// user specified raw input, without header
+				raw = true;
+				break;
+				
+			case 'j':	// user specified number of worker threads
+				numThreads = atol(optionValue(argc, argv));
+				if (numThreads <= 0) {numThreads = thread::hardware_concurrency();}
+				if (numThreads <= 0) {numThreads = 1;}
+				break;
+				
+			case 'q':	// user specified read-ahead queue depth
+				queueDepth = atol(optionValue(argc, argv));
+				break;
+				
+			case 'e':	// user specified sweep end frequency
+				stopFreq = atof(optionValue(argc, argv));
+				break;
+				
+			case 'n':	// user specified number of bursts
+				numSteps = atol(optionValue(argc, argv));
+				break;
+				
+			case 'd':	// user specified sweep steps per decade
+				perDecade = atol(optionValue(argc, argv));
+				break;
+				
+			case 'l':	// user specified frequency list
+				listName = optionValue(argc, argv);
+				break;
+				
+			case 'm':	// user specified tones per multitone burst
+				numTones = atol(optionValue(argc, argv));
+				break;
+				
+			case 't':	// user specified log sweep length
+				sweepTime = atof(optionValue(argc, argv));
+				break;
+				
+			case 'g':	// user specified log sweep gate
+				gateLen = atol(optionValue(argc, argv));
+				break;
+				
+			case 'h':	// user specified highest harmonic
+				numHarm = atol(optionValue(argc, argv));
+				break;
+				
+			case 'k':	// user specified result cache
+				cacheName = optionValue(argc, argv);
+				break;
+				
+			case 'p':	// user specified matched filter precision
+				switch (toupper(*optionValue(argc, argv)))
+				{
+					case 'F': precision = PRECISION_FLOAT; break;
+					case 'I': precision = PRECISION_FIXED; break;
+					default: precision = PRECISION_DOUBLE; break;
+				}
+				break;
+				
+			case 'v':	// user specified how repetitions are combined
+				switch (toupper(*optionValue(argc, argv)))
+				{
+					case 'A': average = AVERAGE_MEAN; break;
+					case 'M': average = AVERAGE_MEDIAN; break;
+					case 'T': average = AVERAGE_TRIM; break;
+					default: average = AVERAGE_SUM; break;
+				}
+				break;
+				
+			case 'c':	// user specified number of channels in raw input
+				rawChan = atol(optionValue(argc, argv));
+				if (rawChan < 1) {rawChan = 1;}
+				break;
+				
+			case 'f':	// user specified result format
+				switch (toupper(*optionValue(argc, argv)))
+				{
+					case 'T': format = SINK_TEXT; break;
+					case 'C': format = SINK_CSV; break;
+					case 'B': format = SINK_RECORDS; break;
+					case 'L': format = SINK_COLUMNS; break;
+					default: argc = 1; continue;
+				}
+				break;
+				
+			case 'o':	// user specified results file
+				outName = optionValue(argc, argv);
+				break;
+				
+			default:	// unknown option, forces usage text below
+				argc = 1;
+				continue;
+		}
+		argc--; argv++;
+	}
 	
 	// check for additional arguments
 	// TODO argument bounds checking not implemented
 	switch(argc)
 	{
-		case 6:		// user specified sweep (the default) or polar
+		case 6:		// user specified sweep (the default), polar or log sweep
 			if (toupper(*argv[5]) == 'P')
 				{myBurst.init(false);}
+			else if (toupper(*argv[5]) == 'L')
+				{logMode = true;}
 			
 		case 5:		// user specified start frequency
 			myBurst.startFreq = atof(argv[4]);
@@ -70,126 +910,360 @@ int main (int argc, char * const argv[])
 		case 4:		// user specified averaging
 			myBurst.numAvg = atol(argv[3]);
 		
-		case 3:		// user specified delay time in samples
-			myBurst.delay = atol(argv[2]);
+		case 3:		// user specified delay time in samples, or auto
+			if (toupper(*argv[2]) == 'A')
+				{autoDelay = true;}
+			else
+				{myBurst.delay = atol(argv[2]);}
 			
 		case 2:		// user specified input file name
 			fname = argv[1];
 			break;
 		
 		default:	// show usage text if wrong number of args
-			cerr << "Useage: tba infile.wav [delay [numAvg [startFreq [sweep|polar]]]]"
+			cerr << "Useage: tba [options] infile.wav [delay [numAvg [startFreq [sweep|polar|log]]]]"
+				"\n  -s  stream input file instead of mapping it into memory"
+				"\n  -r  raw 16 bit samples, without wave file header"
+				"\n  -c  number of channels in raw samples (default 2)"
+				"\n  -q  read ahead this many bursts when streaming, 0 for none (default 2)"
+				"\n  -j  analyze bursts on this many threads, 0 for all cores"
+				"\n  -f  result format: text (default), csv, binary records, or"
+				"\n      lanes, meaning binary columns with each field for all bursts"
+				"\n  -o  write results to outfile instead of the console"
+				"\n  -e  sweep end frequency (default 10000)"
+				"\n  -n  number of bursts (default 201 for sweep, 72 for polar)"
+				"\n  -d  sweep steps per decade, instead of number of bursts"
+				"\n  -l  text file of frequencies, measured in the order given"
+				"\n  -m  tones per burst, each a whole number of cycles in one"
+				"\n      window of " << MULTITONE_SIZE << " samples, all found by one transform"
+				"\n  -t  log sweep length in seconds (default " << SWEEP_SECONDS << ")"
+				"\n  -g  log sweep impulse response gate, in samples (default " << GATE_LENGTH << ")"
+				"\n  -h  also analyze harmonics 2 up to this one (at most " << MAX_HARMONIC << "), in dB"
+				"\n      below the fundamental, with THD from the third harmonic up, since"
+				"\n      each burst carries its own second harmonic; single tone bursts only"
+				"\n  -p  matched filter precision: double (default), float with"
+				"\n      compensated sums, or int fixed point; float and int add an"
+				"\n      error bound column, in dB, for each channel"
+				"\n  -v  combine repetitions by sum (default), or filter each one and"
+				"\n      take the average, median, or trimmed mean without the farthest"
+				"\n      " << 100 * TRIM_FRACTION << "% from the median; all but sum add a noise column, the"
+				"\n      standard error of each response in dB, and use double precision"
+				"\n  -k  keep results in this cache file, and reuse them for any burst"
+				"\n      whose samples and parameters match an earlier run"
+				"\n  --stats  show time per stage, bytes/s and per-burst latency"
+				"\n      on standard error, or in file if named"
+				"\n  --noise  show the noise spectrum of the silent gaps between bursts,"
+				"\n      Welch averaged over " << WELCH_LENGTH << " sample frames, on standard error, or in"
+				"\n      file if named, and add an snr column, in dB above that noise at"
+				"\n      each burst frequency, for each channel; single tone bursts only"
+				"\nWave files may hold 16, 24 or 32 bit integer or 32 bit float samples,"
+				"\nwith any number of channels.  Every channel is analyzed, and each pair"
+				"\nof channels is compared.  The first two channels locate an auto delay."
+				"\nRIFF, RF64 and Wave64 containers are read, so files may pass 4 GB."
+				"\nIf delay is auto, the first burst is found by cross-correlation within"
+				"\nthe first four burst intervals of a mapped file, and reported as onset"
+				"\n(for batch mode, on standard error)."
+				"\nBatch mode analyzes many files with the same setup, one file per thread,"
+				"\nif infile.wav is @list.txt (one name per line) or a quoted wildcard."
+				"\nIf infile.wav is -, samples are streamed from standard input, and each"
+				"\nresult is shown as soon as its burst has arrived."
+				"\nBinary results to the console are written alone, without setup info."
+				"\nBinary layouts are described in toneBurst.h."
 				"\nBuilt " << __DATE__ << '.' << endl;
 			return -1;
 	}
 	
-	// open input file in binary mode
-	ifstream infile(fname, ios::in | ios::binary);
-	if (!infile)
+	// frequency plan options refine whichever mode was chosen
+	if (stopFreq > 0.0) {myBurst.stopFreq = stopFreq;}
+	if (numSteps > 0) {myBurst.numBurst = numSteps;}
+	if (perDecade > 0) {myBurst.perDecade = perDecade;}
+	if (numTones > 1) {myBurst.numTones = numTones;}
+	if (logMode) {myBurst.initLog(long(sweepTime * SAMPLE_RATE));}
+	if (gateLen > 0) {myBurst.gateLen = gateLen;}
+	myBurst.numHarm = numHarm;
+	myBurst.precision = precision;
+	myBurst.average = average;
+	if (noiseSpec) {myBurst.welchLen = WELCH_LENGTH;}
+	if (cacheName && !cache.open(cacheName))
+	{
+		cerr << "Failed to read result cache: " << cacheName << endl;
+		return -2;
+	}
+	if (listName && !myBurst.loadList(listName))
 	{
-		cerr << "Failed to open input file: " << fname << endl;
+		cerr << "Failed to read frequency list: " << listName << endl;
 		return -2;
 	}
 	
-	// read wave file header info from disk
-	// this is brute-force deserialization, which assumes that
-	// the same chunks always appear in the same order
-	infile.read((char *)&myRiff, sizeof(myRiff));
-	infile.read((char *)&myFmt, sizeof(myFmt));
-	infile.read((char *)&myData, sizeof(myData));
-	if (infile.eof())	// test for success
-	{
-		cerr << "Failed to read header info from disk." << endl;
-		return -3;
+	// raw input has no header, so its format comes from the user
+	if (raw) {myBurst.setFormat(SAMPLE_INT16, rawChan);}
+	
+	// results go to console unless a file is named
+	// setup info is shown along with them, unless that would corrupt them
+	ofstream outfile;
+	if (outName)
+	{
+		outfile.open(outName, ios::out | ios::binary);
+		if (!outfile)
+		{
+			cerr << "Failed to open output file: " << outName << endl;
+			return -2;
+		}
 	}
+#ifdef _WIN32
+	else if ((format == SINK_RECORDS) || (format == SINK_COLUMNS))
+		{_setmode(_fileno(stdout), _O_BINARY);}
+#endif
+	ostream &results = outName ? outfile : cout;
 	
-	// let user know who we are
-    cout << "executable:\t" << argv[0]
-	   << "\n arguments:\t" << argc-1
-	   << "\n file name:\t" << fname << endl;
-	   
-	// show wave file header info on console
-	myRiff.dump();
-	myFmt.dump();
-	myData.dump();
-	
-	// show setup for tone burst analysis
-	myBurst.showSetup();
+	// noise spectrum goes to standard error unless a file is named
+	ofstream noisefile;
+	if (noiseName && *noiseName)
+	{
+		noisefile.open(noiseName, ios::out);
+		if (!noisefile)
+		{
+			cerr << "Failed to open noise spectrum file: " << noiseName << endl;
+			return -2;
+		}
+	}
+	ostream *noise = noiseSpec ? ((noiseName && *noiseName) ? &noisefile : &cerr) : 0;
+	bool verbose = outName || (format == SINK_TEXT) || (format == SINK_CSV);
 	
-	// show column headings here
-	cout << "numCyc\tduration\tnomFreq\tactFreq"
-		"\tabs 1\tabs 2\tdB 1\tdB 2\tdB diff"
-		"\tphase 1\tphase 2\tphase diff\tbkg 1\tbkg 2" << endl;
+	// batch mode if more than one input file is named
+	vector<string> fnames;
+	if (!expandNames(fname, fnames))
+	{
+		cerr << "Failed to open input file list: " << fname << endl;
+		return -2;
+	}
+	if (fnames.size() != 1)
+	{
+		// let user know who we are
+		if (verbose)
+		{
+			cout << "executable:\t" << exe
+			   << "\n arguments:\t" << numArgs
+			   << "\nfile count:\t" << fnames.size() << endl;
+			myBurst.showSetup();
+		}
+		
+		// show column headings here, tagged with file name
+		// channels are counted from the first file that has a usable header
+		for (size_t k = 0; !raw && (k < fnames.size()); k++)
+		{
+			const char *problem = 0;
+			ifstream first(fnames[k].c_str(), ios::in | ios::binary);
+			if (first && !checkHeader(first, myHeader, myBurst, problem)) {break;}
+		}
+		resultSink(myBurst, format, results).showHeading("file");
 		
-	// wait for one delay time before analyzing waveform data
-	long i = 0;
-	short a = 0;
-	for (i = 0; i < myBurst.delay; i++)
+		// plan all bursts once, shared by all files
+		// with automatic delay, offsets are relative to each file's onset
+		vector<burstStep> steps;
+		if (autoDelay) {myBurst.delay = 0;}
+		myBurst.plan(steps);
+		if (numThreads == 0) {numThreads = thread::hardware_concurrency();}
+		if (numThreads <= 0) {numThreads = 1;}
+		return analyzeBatch(myBurst, steps, fnames, numThreads, raw, autoDelay,
+			format, results, noise, cache, stats);
+	}
+	fname = fnames[0].c_str();
+	if (numThreads == 0) {numThreads = 1;}
+	
+	// standard input is always streamed, since it cannot be mapped
+	bool piped = (strcmp(fname, "-") == 0);
+	if (piped)
 	{
-		// discard data from both channels during delay
-		infile.read((char *)&a, 2);
-		infile.read((char *)&a, 2);
+		mapped = false;
+#ifdef _WIN32
+		_setmode(_fileno(stdin), _O_BINARY);
+#endif
 	}
 	
-	// iterate over tone bursts while reading from disk
-	for(myBurst.reset(); myBurst.good(); myBurst.next())
+	// open input file in binary mode
+	ifstream infile;
+	if (!piped)
 	{
-		// check input file before reading
-		if (infile.eof())
+		infile.open(fname, ios::in | ios::binary);
+		if (!infile)
 		{
-			cerr << "Failed to read tone bursts from disk." << endl;
+			cerr << "Failed to open input file: " << fname << endl;
+			return -2;
+		}
+	}
+	istream &input = piped ? cin : infile;
+	
+	// read wave file header info from disk
+	// chunks are walked in order, up to the start of sound data
+	if (!raw)
+	{
+		const char *problem = 0;
+		double start = stats.now();
+		int code = checkHeader(input, myHeader, myBurst, problem);
+		stats.add(STAGE_HEADER, start);
+		if (code)
+		{
+			cerr << problem << '.' << endl;
+			return code;
+		}
+	}
+	
+	// otherwise map the whole file, to analyze sound data in place
+	waveMap myMap;
+	const char *frames = 0;
+	int64_t numData = 0;
+	double onset = 0.0;
+	if (mapped)
+	{
+		infile.close();
+		double start = stats.now();
+		bool opened = myMap.open(fname);
+		stats.add(STAGE_READ, start);
+		if (!opened)
+		{
+			cerr << "Failed to map input file: " << fname << endl;
+			return -2;
+		}
+		
+		// sound data follows immediately after the data chunk header
+		frames = myMap.data() + (raw ? 0 : size_t(myHeader.dataOffset));
+		numData = countFrames(myHeader, myMap.size(), raw, myBurst.getFrameSize());
+	}
+	
+	// find first burst before showing setup, since it sets the delay
+	if (autoDelay)
+	{
+		if (!mapped)
+		{
+			cerr << "Automatic delay needs a mapped input file." << endl;
+			return -1;
+		}
+		double start = stats.now();
+		onset = myBurst.findOnset(frames, numData);
+		stats.add(STAGE_DELAY, start);
+		if (onset < 0.0)
+		{
+			cerr << "Failed to find first tone burst." << endl;
 			return -4;
 		}
-		myBurst.showDetail();
-		cout << '\t';
-		myBurst.read(infile);
+		myBurst.delay = long(llround(onset));	// nearest whole frame to onset
 	}
-
-	// report success
-    return 0;
-}
-
-// show chunk details on console
-void chunkHead::dump()
-{
-	// convert character array to null-terminated string
-    char s[5] = "ABCD";
-    memcpy(s, chunkID, 4);
 	
-	// show on console
-    cout << "   chunkID:\t" << s << endl;
-	cout << " chunkSize:\t" << chunkSize << endl;
-}
-
-// show RIFF chunk details on console
-void riffChunk::dump()
-{
-	chunkHead::dump();	// invoke method in superclass
-
-	// convert character array to null-terminated string
-    char s[5] = "ABCD";
-    memcpy(s, format, 4);
+	// let user know who we are
+	if (verbose)
+	{
+		cout << "executable:\t" << exe
+		   << "\n arguments:\t" << numArgs
+		   << "\n file name:\t" << fname << endl;
+		   
+		// show wave file header info on console
+		if (!raw) {myHeader.dump();}
+		
+		// show setup for tone burst analysis
+		myBurst.showSetup();
+		if (autoDelay) {cout << "     onset:\t" << onset << endl;}
+	}
 	
-	// show on console
-    cout << "    format:\t" << s << endl;
-}
-
-// show fmt chunk details on console
-void fmtChunk::dump()
-{
-	chunkHead::dump();	// invoke method in superclass
+	// show column headings here
+	resultSink sink(myBurst, format, results);
+	sink.setNoise(noise);
+	sink.showHeading();
+	if (autoDelay) {sink.setOnset(onset);}
+		
+	// analyze from stream, one burst interval at a time
+	// memory use is one burst, and each line is shown as soon as it is ready
+	if (!mapped)
+	{
+		// wait for one delay time before analyzing waveform data
+		double start = stats.now();
+		input.ignore(streamsize(myBurst.getFrameSize()) * myBurst.delay);
+		stats.add(STAGE_DELAY, start);
+		stats.addBytes(double(myBurst.getFrameSize()) * myBurst.delay);
+		size_t burstSize = size_t(myBurst.getFrameSize()) * myBurst.getSpan();
+		
+		// iterate over tone bursts while reading from disk or pipe
+		// each burst is read, analyzed and shown in turn, timed separately
+		if (queueDepth <= 0)
+		{
+			vector<char> buffer(burstSize);
+			for(myBurst.reset(); myBurst.good(); myBurst.next())
+			{
+				start = stats.now();
+				input.read(&buffer[0], burstSize);
+				stats.add(STAGE_READ, start);
+				if (input.gcount() != (streamsize)burstSize)
+				{
+					sink.finish();
+					cerr << "Failed to read tone bursts from disk." << endl;
+					return -4;
+				}
+				stats.addBytes(double(burstSize));
+				showBurst(myBurst, &buffer[0], sink, cache, stats);
+				if (piped) {results.flush();}
+			}
+			sink.finish();
+			return 0;
+		}
+		
+		// otherwise overlap reading the next bursts with analyzing this one
+		vector<burstStep> steps;
+		myBurst.plan(steps);
+		burstQueue queue(input, burstSize, (long)steps.size(), queueDepth);
+		for(myBurst.reset(); myBurst.good(); myBurst.next())
+		{
+			start = stats.now();
+			const char *frames = queue.front();
+			stats.add(STAGE_READ, start);
+			if (!frames)
+			{
+				sink.finish();
+				cerr << "Failed to read tone bursts from disk." << endl;
+				return -4;
+			}
+			stats.addBytes(double(burstSize));
+			showBurst(myBurst, frames, sink, cache, stats);
+			queue.pop();
+			if (piped) {results.flush();}
+		}
+		sink.finish();
+		return 0;
+	}
 	
-	// show remaining data members on console
-	cout <<  "   fmtCode:\t" << fmtCode
-		<< "\n   numChan:\t" << numChan
-		<< "\n  sampRate:\t" << sampRate
-		<< "\n  byteRate:\t" << byteRate
-		<< "\nblockAlign:\t" << blockAlign
-		<< "\n  bitsSamp:\t" << bitsSamp << endl;
+	// plan all bursts up front, so they may be analyzed in any order
+	vector<burstStep> steps;
+	myBurst.plan(steps);
+	
+	// analyze only bursts which are complete in the mapped data
+	// results shown in frequency order
+	long numReady = countReady(myBurst, steps, numData);
+	analyzeBursts(myBurst, steps, numReady, frames, numThreads, sink, cache, stats);
+	double start = stats.now();
+	sink.finish();
+	stats.add(STAGE_OUTPUT, start);
+	if (numReady < (long)steps.size())
+	{
+		cerr << "Failed to read tone bursts from disk." << endl;
+		return -4;
+	}
+
+	// report success
+    return 0;
 }
 
-// show data chunk details on console
-void dataChunk::dump()
+// main entry point for waveform analyzer
+// stats, if asked for, are shown however the run ends
+int main (int argc, char * const argv[])
 {
-	chunkHead::dump();	// invoke method in superclass
+	runStats stats;
+	resultCache cache;
+	long numThreads = 0;	// number of worker threads, 0 picks a default
+	int code = analyzeMain(argc, argv, stats, cache, numThreads);
+	if (!cache.save())
+	{
+		cerr << "Failed to write result cache." << endl;
+		if (!code) {code = -2;}
+	}
+	stats.show(numThreads);
+	return code;
 }
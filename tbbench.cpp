@@ -0,0 +1,355 @@
+//---------------------------------------------------------------------
+// tbbench.cpp implements a command line utility to time the tone burst
+// generator and analyzer, and to check the analyzer against the
+// original matched filter, which called exp() once per sample.
+//
+// A capture is synthesized in memory by the same code as tbg, then
+// copied to as many channels as requested.  Each stage is run several
+// times, and the fastest pass is reported in samples, megabytes and
+// bursts per second.  Nothing is read from or written to disk, so the
+// numbers show the cost of the code itself.
+//
+// This code is placed in the public domain for the benefit and
+// entertaiment of audio enthusiasts and hobbyists.  Any and all uses
+// are encouraged but not supported by the author.
+//---------------------------------------------------------------------
+
+// includes are limited to just a few standard files
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <complex>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <stdint.h>
+#include <chrono>
+
+// include the toneBurst class for this project
+#include "toneBurst.h"
+
+using namespace std;
+
+// largest difference allowed between analyzer and reference, +0 dB = 1.0
+#define TOLERANCE 1e-12
+
+// get value of an option, either joined (-j4) or as the next argument (-j 4)
+static const char *optionValue(int &argc, char * const *&argv)
+{
+	if (argv[1][2]) {return &argv[1][2];}
+	if (argc > 2) {argc--; argv++; return argv[1];}
+	return "";
+}
+
+// seconds since start
+static double elapsed(chrono::steady_clock::time_point start)
+{
+	return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// show throughput for one stage, from its fastest pass
+static void showRate(const char *stage, double seconds, double samples,
+	double bytes, double bursts)
+{
+	cout << stage
+		<< '\t' << seconds
+		<< '\t' << samples / seconds
+		<< '\t' << bytes / seconds / 1e6
+		<< '\t' << bursts / seconds << endl;
+}
+
+// original matched filter, one exp() per sample
+// frames point to interleaved 16 bit samples at the start of this burst
+static void referenceDFT(const burstStep &step, const char *frames,
+	long numChan, long interval, long numAvg, burstResult &result)
+{
+	long i = 0, j = 0;		// local loop indices, NOT sqrt(-1)
+	long c = 0;				// local channel index
+	long duration = step.duration;
+	complex<double> cfactor(0, step.factor);
+	result.resp.assign(numChan, complex<double>(0,0));
+	result.bkg.assign(numChan, complex<double>(0,0));
+
+	// iterate over averaging, burst interval
+	for (i = 0; i < numAvg; i++)
+	for (j = 0; j < interval; j++, frames += 2 * numChan)
+	{
+		bool inBurst = (j < duration);
+		bool inBkg = (j < (interval - duration)) && (j >= (interval - (2 * duration)));
+		if (!inBurst && !inBkg) {continue;}
+		complex<double> ccoeff = exp(cfactor * double(j));
+		for (c = 0; c < numChan; c++)
+		{
+			double a = int16_t(getLE16(frames + 2 * c));
+			if (inBurst) {result.resp[c] += a * ccoeff;}
+			if (inBkg) {result.bkg[c] += a * ccoeff;}
+		}
+	}
+
+	// factor out sample count and averaging, normalize to +0 dB
+	for (c = 0; c < numChan; c++)
+	{
+		result.resp[c] /= (duration * numAvg * AMPLITUDE / 2.0);
+		result.bkg[c] /= (duration * numAvg * AMPLITUDE / 2.0);
+	}
+}
+
+// main entry point for benchmark
+int main (int argc, char * const argv[])
+{
+	// instantiate a tone burst object
+	toneBurst myBurst;
+
+	// set default values
+	const char *exe = argv[0];
+	long numChan = 2;			// channels in synthesized capture
+	long sampleRate = SAMPLE_RATE;
+	long numPass = 3;			// passes per stage, fastest is shown
+	bool polar = false;			// freq sweep unless told otherwise
+
+	// check for option flags, there are no other arguments
+	while ((argc > 1) && (argv[1][0] == '-') && argv[1][1])
+	{
+		switch (argv[1][1])
+		{
+			case 'c':	// user specified number of channels
+				numChan = atol(optionValue(argc, argv));
+				break;
+
+			case 'a':	// user specified averaging
+				myBurst.numAvg = atol(optionValue(argc, argv));
+				break;
+
+			case 'r':	// user specified sample rate
+				sampleRate = atol(optionValue(argc, argv));
+				break;
+
+			case 'n':	// user specified number of passes
+				numPass = atol(optionValue(argc, argv));
+				break;
+
+			case 'p':	// user specified polar mode
+				polar = true;
+				break;
+
+			case 'h':	// user specified highest harmonic
+				myBurst.numHarm = atol(optionValue(argc, argv));
+				break;
+
+			case 'x':	// user specified matched filter precision
+				switch (toupper(*optionValue(argc, argv)))
+				{
+					case 'F': myBurst.precision = PRECISION_FLOAT; break;
+					case 'I': myBurst.precision = PRECISION_FIXED; break;
+					default: myBurst.precision = PRECISION_DOUBLE; break;
+				}
+				break;
+
+			default:	// unknown option, forces usage text below
+				argc = 0;
+				continue;
+		}
+		argc--; argv++;
+	}
+	if ((argc != 1) || (numChan < 1) || (myBurst.numAvg < 1) ||
+		(sampleRate < 8000) || (numPass < 1))
+	{
+		cerr << "Useage: tbbench [-c chans] [-a numAvg] [-r rate] [-n passes] [-p] [-h harm] [-x prec]"
+			"\n  -c  channels in synthesized capture (default 2)"
+			"\n  -a  number of bursts to average over (default 1)"
+			"\n  -r  sample rate, burst timing is kept the same (default 44100)"
+			"\n  -n  time each stage this many times, fastest is shown (default 3)"
+			"\n  -p  polar plot instead of freq sweep"
+			"\n  -h  also analyze harmonics up to this one, in the same pass"
+			"\n  -x  matched filter precision: double (default), float or int"
+			"\nStages are timed in memory, then every burst is checked against"
+			"\nthe original exp() matched filter, within " << TOLERANCE << " of +0 dB,"
+			"\nor for float and int, within the error bound found for each burst."
+			"\nBuilt " << __DATE__ << '.' << endl;
+		return -1;
+	}
+
+	// set up bursts the same way as tbg and tba
+	if (polar) {myBurst.init(false);}
+	myBurst.setRate(sampleRate);
+	vector<burstStep> steps;
+	myBurst.plan(steps);
+	long numBursts = (long)steps.size();
+	int64_t span = myBurst.getSpan();
+	long interval = long(span / myBurst.numAvg);
+
+	// let user know who we are
+	cout << "executable:\t" << exe
+	   << "\n  channels:\t" << numChan
+	   << "\n  sampRate:\t" << sampleRate
+	   << "\n    passes:\t" << numPass << endl;
+	myBurst.showSetup();
+	cout << "stage\tseconds\tsamples/s\tMB/s\tbursts/s" << endl;
+
+	// generate: synthesize 16 bit stereo, as tbg writes it
+	// rendered straight into one buffer, each interval copied numAvg times
+	vector<char> stereo(2 * 2 * (myBurst.delay + span * numBursts) + 1, 0);
+	double best = 0.0;
+	for (long pass = 0; pass < numPass; pass++)
+	{
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		for (long k = 0; k < numBursts; k++)
+		{
+			char *burst = &stereo[2 * 2 * steps[k].offset];
+			myBurst.render(steps[k], burst);
+			for (long i = 1; i < myBurst.numAvg; i++)
+			{
+				memcpy(burst + 2 * 2 * interval * i, burst, 2 * 2 * interval);
+			}
+		}
+		double seconds = elapsed(start);
+		if ((pass == 0) || (seconds < best)) {best = seconds;}
+	}
+	showRate("generate", best, (stereo.size() - 1) / 2.0, stereo.size() - 1, numBursts);
+
+	// copy to the requested number of channels, alternating the two
+	long numFrames = (long)(stereo.size() - 1) / 4;
+	long frameSize = 2 * numChan;
+	vector<char> frames(frameSize * numFrames + 1);
+	for (long f = 0; f < numFrames; f++)
+	for (long c = 0; c < numChan; c++)
+	{
+		memcpy(&frames[frameSize * f + 2 * c], &stereo[4 * f + 2 * (c % 2)], 2);
+	}
+	myBurst.setFormat(SAMPLE_INT16, numChan);
+	double bytes = double(frameSize) * span * numBursts;
+	double samples = bytes / 2.0;
+
+	// plan: run the frequency iterator, many times since it is quick
+	long numPlan = 1000;
+	for (long pass = 0; pass < numPass; pass++)
+	{
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		for (long k = 0; k < numPlan; k++) {myBurst.plan(steps);}
+		double seconds = elapsed(start) / numPlan;
+		if ((pass == 0) || (seconds < best)) {best = seconds;}
+	}
+	showRate("plan", best, 0.0, 0.0, numBursts);
+
+	// header: write a wave header as tbg does, then read it back as tba does
+	// both sides use an in-memory stream, many times since it is quick
+	long numHead = 1000;
+	uint64_t dataSize = uint64_t(stereo.size() - 1);
+	riffChunk myRiff;
+	fmtChunk myFmt;
+	dataChunk myData;
+	myRiff.setSize(dataSize);
+	myFmt.setSize();
+	myData.setSize(dataSize);
+	size_t headSize = 0;
+	for (long pass = 0; pass < numPass; pass++)
+	{
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		for (long k = 0; k < numHead; k++)
+		{
+			ostringstream out(ios::out | ios::binary);
+			myRiff.write(out);
+			myFmt.write(out);
+			myData.write(out);
+			istringstream in(out.str(), ios::in | ios::binary);
+			waveHeader myHeader;
+			if (!myHeader.read(in) || (myHeader.data.getSize() != dataSize))
+			{
+				cerr << "Wave header did not read back." << endl;
+				return -5;
+			}
+			headSize = size_t(myHeader.dataOffset);
+		}
+		double seconds = elapsed(start) / numHead;
+		if ((pass == 0) || (seconds < best)) {best = seconds;}
+	}
+	showRate("header", best, 0.0, double(headSize), 0.0);
+
+	// analyze: matched filter only, one thread, in plan order
+	// results are reused from pass to pass, as a library caller would
+	vector<burstResult> results(numBursts);
+	for (long pass = 0; pass < numPass; pass++)
+	{
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		if (myBurst.analyzeFrames(&frames[0], numFrames, &results[0]) != numBursts)
+		{
+			cerr << "Capture is missing bursts." << endl;
+			return -5;
+		}
+		double seconds = elapsed(start);
+		if ((pass == 0) || (seconds < best)) {best = seconds;}
+	}
+	showRate("analyze", best, samples, bytes, numBursts);
+
+	// read: matched filter plus text results, as tba shows them
+	for (long pass = 0; pass < numPass; pass++)
+	{
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		ostringstream text;
+		resultSink sink(myBurst, SINK_TEXT, text);
+		const char *burstFrames = &frames[frameSize * myBurst.delay];
+		for (myBurst.reset(); myBurst.good(); myBurst.next())
+		{
+			myBurst.read(burstFrames, sink);
+		}
+		sink.finish();
+		double seconds = elapsed(start);
+		if ((pass == 0) || (seconds < best)) {best = seconds;}
+	}
+	showRate("read", best, samples, bytes, numBursts);
+
+	// reference: original matched filter, timed once, then compared
+	vector<burstResult> refs(numBursts);
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (long k = 0; k < numBursts; k++)
+	{
+		referenceDFT(steps[k], &frames[frameSize * steps[k].offset],
+			numChan, interval, myBurst.numAvg, refs[k]);
+	}
+	showRate("reference", elapsed(start), samples, bytes, numBursts);
+
+	// worst differences over all bursts and channels
+	// dB and phase are only meaningful where there is signal
+	// reduced precision is held to its own bound instead, burst by burst
+	double worst = 0.0, worstDB = 0.0, worstPhase = 0.0;
+	double worstBound = 0.0, worstRatio = 0.0;
+	for (long k = 0; k < numBursts; k++)
+	for (long c = 0; c < numChan; c++)
+	{
+		complex<double> resp = results[k].resp[c], ref = refs[k].resp[c];
+		worst = max(worst, abs(resp - ref));
+		worst = max(worst, abs(results[k].bkg[c] - refs[k].bkg[c]));
+		if (!results[k].err.empty())
+		{
+			double bound = results[k].err[c] + TOLERANCE;
+			worstBound = max(worstBound, bound);
+			worstRatio = max(worstRatio, abs(resp - ref) / bound);
+		}
+		if (abs(ref) < 1e-3) {continue;}
+		worstDB = max(worstDB, fabs(20.0*log10(abs(resp)/abs(ref))));
+		worstPhase = max(worstPhase, fabs(arg(resp / ref)));
+	}
+	cout << "  max diff:\t" << worst
+	   << "\n    max dB:\t" << worstDB
+	   << "\n max phase:\t" << worstPhase << endl;
+	if (myBurst.getPrecision() != PRECISION_DOUBLE)
+	{
+		cout << " max bound:\t" << worstBound
+		   << "\n diff/bound:\t" << worstRatio << endl;
+		if (worstRatio > 1.0)
+		{
+			cerr << "Analyzer differs from reference by more than its bound." << endl;
+			return -5;
+		}
+		return 0;
+	}
+	if (worst > TOLERANCE)
+	{
+		cerr << "Analyzer differs from reference by " << worst << '.' << endl;
+		return -5;
+	}
+
+	// report success
+	return 0;
+}
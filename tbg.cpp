@@ -7,18 +7,17 @@
 // This version built on 12/6/08 MSW.
 //
 // Generated wave data is written to disk in a file that you
-// name as a command line argument.  Text output describing the
-// wave data is sent to the console, which you should redirect
-// to a text file.
+// name as a command line argument, or to standard output, so it may be
+// piped straight to a player.  Text output describing the wave data is
+// sent to the console, which you should redirect to a text file.
 //
 // This source code was originally built using XCode 2.2.1
 // on an Apple MacBook Pro with Intel Core Duo processor.
 // Also built (with trivial changes) and tested under MSVC++ 6.0.
 // While it is meant to be easily ported to other environments,
-// it should NOT be considered portable, in that it relies heavily
-// on specific data sizes and struct packing to match the .WAV format.
-// It is meant for Intel byte ordering, and will almost certainly fail
-// if built for Motorola or PPC processors.
+// wave file headers and samples are read and written field by field,
+// in little-endian order, so do not depend on struct packing or on
+// the byte ordering of the host processor.
 //
 // This code is placed in the public domain for the benefit and
 // entertaiment of audio enthusiasts and hobbyists.  Any and all uses
@@ -28,23 +27,210 @@
 // includes are limited to just a few standard files
 #include <iostream>
 #include <fstream>
+#include <complex>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <stdint.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <sstream>
 // #include <assert.h>	// uncomment this line for MSVC++ 6.0
 
+// platform files needed to write binary data to standard output
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
 // include the toneBurst class for this project
 #include "toneBurst.h"
 
 using namespace std;
 
+// bytes per output block, large so each write to a file or pipe is cheap
+#define BLOCK_SIZE (1 << 20)
+
+// synthesize the whole data chunk, delay then every burst, in large blocks
+// each full block is handed to emit, then the last partial one, if any
+// emit may swap the block for an empty one of its own
+// stops early, returning false, if emit does
+static bool generate(toneBurst &myBurst, size_t blockSize,
+	const function<bool(vector<char> &)> &emit)
+{
+	vector<burstStep> steps;
+	myBurst.plan(steps);
+	size_t intervalSize = 2 * 2 * (myBurst.getSpan() / myBurst.numAvg);
+	vector<char> burst(intervalSize);
+	vector<char> block;
+	block.reserve(blockSize);
+	
+	// copy any number of bytes into blocks, null for silence
+	auto put = [&](const char *p, size_t n) -> bool
+	{
+		while (n > 0)
+		{
+			size_t used = block.size();
+			size_t count = (n < blockSize - used) ? n : blockSize - used;
+			if (p) {block.insert(block.end(), p, p + count); p += count;}
+			else {block.resize(used + count, 0);}
+			n -= count;
+			if (block.size() < blockSize) {continue;}
+			if (!emit(block)) {return false;}
+			block.clear();
+			block.reserve(blockSize);
+		}
+		return true;
+	};
+	
+	// one delay time of silence, then each burst once per repetition
+	if (!put(0, 2 * 2 * size_t(myBurst.delay))) {return false;}
+	for (size_t k = 0; k < steps.size(); k++)
+	{
+		myBurst.render(steps[k], &burst[0]);
+		for (long i = 0; i < myBurst.numAvg; i++)
+		{
+			if (!put(&burst[0], intervalSize)) {return false;}
+		}
+	}
+	return block.empty() || emit(block);
+}
+
+// generate-ahead queue for output, a ring of large blocks
+// a generator thread synthesizes the next blocks while the oldest is written,
+// so a slow consumer never waits on synthesis once the ring is full
+class blockQueue
+{
+private:
+	// data members
+	toneBurst &burst;	// generator, used only by its own thread
+	size_t blockSize;	// number of bytes per full block
+	vector< vector<char> > slots;	// ring of blocks
+	size_t head;		// index of oldest filled slot
+	size_t count;		// number of filled slots
+	bool done;			// true once generator has stopped
+	bool stopped;		// true if the writer gave up
+	mutex lock;
+	condition_variable filled;	// signals writer, a slot was filled
+	condition_variable emptied;	// signals generator, a slot was released
+	thread generator;
+	
+	// method members
+	void run();			// generator thread body
+	bool post(vector<char> &block);	// swap a full block into the ring
+	
+public:
+	blockQueue(toneBurst &theBurst, size_t theSize, long depth);
+	~blockQueue();		// destructor stops the generator, and waits for it
+	const vector<char> *front();	// wait for next block, null if no more
+	void pop();			// release oldest block, so its slot can be refilled
+};
+
+// start generating ahead as soon as queue is constructed
+blockQueue::blockQueue(toneBurst &theBurst, size_t theSize, long depth)
+	: burst(theBurst), blockSize(theSize), slots(depth), head(0), count(0),
+	done(false), stopped(false)
+{
+	generator = thread(&blockQueue::run, this);
+}
+
+// a writer which stops early releases the generator too
+blockQueue::~blockQueue()
+{
+	{
+		lock_guard<mutex> guard(lock);
+		stopped = true;
+		emptied.notify_one();
+	}
+	generator.join();
+}
+
+// generator thread, fills free slots in order
+void blockQueue::run()
+{
+	generate(burst, blockSize, [this](vector<char> &block) {return post(block);});
+	
+	// no more blocks will arrive
+	lock_guard<mutex> guard(lock);
+	done = true;
+	filled.notify_one();
+}
+
+// wait for a free slot, then trade the full block for its old buffer
+bool blockQueue::post(vector<char> &block)
+{
+	unique_lock<mutex> guard(lock);
+	while ((count == slots.size()) && !stopped) {emptied.wait(guard);}
+	if (stopped) {return false;}
+	slots[(head + count) % slots.size()].swap(block);
+	count++;
+	filled.notify_one();
+	return true;
+}
+
+// wait for the oldest filled slot
+const vector<char> *blockQueue::front()
+{
+	unique_lock<mutex> guard(lock);
+	while ((count == 0) && !done) {filled.wait(guard);}
+	return count ? &slots[head] : 0;
+}
+
+// release the oldest slot for reuse
+void blockQueue::pop()
+{
+	lock_guard<mutex> guard(lock);
+	head = (head + 1) % slots.size();
+	count--;
+	emptied.notify_one();
+}
+
+// get value for an option flag, either attached (-n36) or next argument (-n 36)
+static const char *optionValue(int &argc, char * const *&argv)
+{
+	if (argv[1][2]) {return &argv[1][2];}
+	if (argc > 2) {argc--; argv++; return argv[1];}
+	return "";
+}
+
+// synthesize every burst straight into a mapped output file, on many threads
+// each burst sits at a fixed offset, so workers claim bursts in any order,
+// render one interval in place, then copy it once per further repetition
+// the delay before the first burst is left as the zeros of a new file
+static void generateMapped(const toneBurst &myBurst,
+	const vector<burstStep> &steps, char *data, long numThreads)
+{
+	size_t numBurst = steps.size();
+	size_t intervalSize = 2 * 2 * (myBurst.getSpan() / myBurst.numAvg);
+	atomic<size_t> nextBurst(0);
+	
+	// each worker claims the next unclaimed burst until none remain
+	auto worker = [&]()
+	{
+		size_t k = 0;
+		while ((k = nextBurst++) < numBurst)
+		{
+			char *burst = data + 2 * 2 * size_t(steps[k].offset);
+			myBurst.render(steps[k], burst);
+			for (long i = 1; i < myBurst.numAvg; i++)
+				{memcpy(burst + intervalSize * i, burst, intervalSize);}
+		}
+	};
+	
+	// bounded pool, never more workers than bursts
+	if ((size_t)numThreads > numBurst) {numThreads = (long)numBurst;}
+	vector<thread> pool;
+	for (long t = 0; t < numThreads; t++) {pool.push_back(thread(worker));}
+	for (size_t t = 0; t < pool.size(); t++) {pool[t].join();}
+}
+
 // main entry point for waveform generator
 int main (int argc, char * const argv[])
 {	
-	// check object sizes while debugging
-	assert(sizeof(long) == 4);
-	assert(sizeof(short) == 2);
-	assert(sizeof(riffChunk) == 12);
-	assert(sizeof(fmtChunk) == 24);
-	assert(sizeof(dataChunk) == 8);
-	
 	// instantiate a tone burst object
 	toneBurst myBurst;
 
@@ -55,14 +241,88 @@ int main (int argc, char * const argv[])
 	
 	// set default values
 	const char *fname = "outfile.wav";
+	const char *exe = argv[0];
+	int numArgs = argc - 1;
+	double stopFreq = 0.0;	// sweep end frequency, 0 for default
+	long numSteps = 0;		// number of bursts, 0 for default
+	long perDecade = 0;		// sweep steps per decade, 0 if not used
+	const char *listName = 0;	// frequency list file, or null
+	long numTones = 0;		// tones per burst, 0 for single tone bursts
+	bool logMode = false;	// tone bursts unless told otherwise
+	double sweepTime = SWEEP_SECONDS;	// log sweep length in seconds
+	waveContainer kind = WAVE_RIFF;	// RF64 anyway if data passes 4 GB
+	bool raw = false;		// wave file header unless told otherwise
+	long queueDepth = 4;	// number of blocks to generate ahead
+	long numThreads = 1;	// one writer in order, unless told otherwise
+	
+	// check for leading option flags
+	while ((argc > 1) && (argv[1][0] == '-') && argv[1][1])
+	{
+		switch (argv[1][1])
+		{
+			case 'e':	// user specified sweep end frequency
+				stopFreq = atof(optionValue(argc, argv));
+				break;
+				
+			case 'n':	// user specified number of bursts
+				numSteps = atol(optionValue(argc, argv));
+				break;
+				
+			case 'd':	// user specified sweep steps per decade
+				perDecade = atol(optionValue(argc, argv));
+				break;
+				
+			case 'l':	// user specified frequency list
+				listName = optionValue(argc, argv);
+				break;
+				
+			case 'm':	// user specified tones per multitone burst
+				numTones = atol(optionValue(argc, argv));
+				break;
+				
+			case 't':	// user specified log sweep length
+				sweepTime = atof(optionValue(argc, argv));
+				break;
+				
+			case 'r':	// user specified raw output, without header
+				raw = true;
+				break;
+				
+			case 'j':	// user specified number of worker threads
+				numThreads = atol(optionValue(argc, argv));
+				if (numThreads == 0) {numThreads = thread::hardware_concurrency();}
+				if (numThreads <= 0) {numThreads = 1;}
+				break;
+				
+			case 'q':	// user specified generate-ahead queue depth
+				queueDepth = atol(optionValue(argc, argv));
+				break;
+				
+			case 'w':	// user specified wave container
+				switch (toupper(*optionValue(argc, argv)))
+				{
+					case 'R': kind = WAVE_RF64; break;
+					case 'W': kind = WAVE_W64; break;
+					default: kind = WAVE_RIFF; break;
+				}
+				break;
+				
+			default:	// unknown option, forces usage text below
+				argc = 1;
+				continue;
+		}
+		argc--; argv++;
+	}
 	
 	// check for additional arguments
 	// TODO argument bounds checking not implemented
 	switch(argc)
 	{
-		case 6:		// user specified sweep (the default) or polar
+		case 6:		// user specified sweep (the default), polar or log sweep
 			if (toupper(*argv[5]) == 'P')
 				{myBurst.init(false);}
+			else if (toupper(*argv[5]) == 'L')
+				{logMode = true;}
 			
 		case 5:		// user specified start frequency
 			myBurst.startFreq = atof(argv[4]);
@@ -78,98 +338,174 @@ int main (int argc, char * const argv[])
 			break;
 		
 		default:	// show usage text if wrong number of args
-			cerr << "Useage: tbg outfile.wav [delay [numAvg [startFreq [sweep|polar]]]]"
+			cerr << "Useage: tbg [options] outfile.wav [delay [numAvg [startFreq [sweep|polar|log]]]]"
+				"\n  -e  sweep end frequency (default 10000)"
+				"\n  -n  number of bursts (default 201 for sweep, 72 for polar)"
+				"\n  -d  sweep steps per decade, instead of number of bursts"
+				"\n  -l  text file of frequencies, measured in the order given"
+				"\n  -m  tones per burst, each a whole number of cycles in one"
+				"\n      window of " << MULTITONE_SIZE << " samples, all found by one transform"
+				"\n  -t  log sweep length in seconds (default " << SWEEP_SECONDS << ")"
+				"\n  -w  wave container: riff (default), rf64 or w64, where riff becomes"
+				"\n      rf64 by itself once the data passes 4 GB"
+				"\n  -r  raw 16 bit stereo samples, without wave file header"
+				"\n  -q  generate this many blocks of " << (BLOCK_SIZE >> 20) << " MB ahead of the"
+				"\n      writer, 0 for none (default 4)"
+				"\n  -j  synthesize bursts on this many threads, 0 for all cores, each"
+				"\n      straight into place in the output file, mapped into memory;"
+				"\n      standard output is always written in order, on one thread"
+				"\nIf outfile.wav is -, samples go to standard output, for a player to"
+				"\nread as they are made, and text goes to standard error.  Sizes are"
+				"\nknown before the first sample, so the header is complete as written."
 				"\nBuilt " << __DATE__ << '.' << endl;
 			return -1;
 	}
 	
+	// frequency plan options refine whichever mode was chosen
+	if (stopFreq > 0.0) {myBurst.stopFreq = stopFreq;}
+	if (numSteps > 0) {myBurst.numBurst = numSteps;}
+	if (perDecade > 0) {myBurst.perDecade = perDecade;}
+	if (numTones > 1) {myBurst.numTones = numTones;}
+	if (logMode) {myBurst.initLog(long(sweepTime * SAMPLE_RATE));}
+	if (listName && !myBurst.loadList(listName))
+	{
+		cerr << "Failed to read frequency list: " << listName << endl;
+		return -2;
+	}
+	
 	// calculate header details for this wave file
-	long theSize = myBurst.getSize();
-	myRiff.setSize(theSize);
+	// plain RIFF sizes are 32 bits, so larger files switch to RF64
+	uint64_t theSize = myBurst.getSize();
+	if ((kind == WAVE_RIFF) && (theSize + 36 > 0xFFFFFFFF)) {kind = WAVE_RF64;}
+	myRiff.setSize(theSize, kind);
 	myFmt.setSize();
 	myData.setSize(theSize);
 	
-	// open output file in binary mode
-	ofstream outfile(fname, ios::out | ios::binary);
-	if (!outfile)	// test for success
+	// many threads write a mapped file, with its header first
+	// the file is made at its full size, so bursts land in any order
+	bool piped = !strcmp(fname, "-");
+	if (!piped && (numThreads > 1))
 	{
-		cerr << "Failed to open output file: " << fname << endl;
-		return -2;
+		ostringstream head(ios::out | ios::binary);
+		if (!raw)
+		{
+			myRiff.write(head);
+			myFmt.write(head, kind);
+			myData.write(head, kind);
+		}
+		string header = head.str();
+		waveOutMap myMap;
+		if (!myMap.create(fname, header.size() + size_t(theSize)))
+		{
+			cerr << "Failed to open output file: " << fname << endl;
+			return -2;
+		}
+		memcpy(myMap.data(), header.data(), header.size());
+		
+		// show setup info, then fill in every burst
+		cout << "executable:\t" << exe
+		   << "\n arguments:\t" << numArgs
+		   << "\n file name:\t" << fname
+		   << "\n   threads:\t" << numThreads << endl;
+		myBurst.showSetup();
+		cout << "numCyc\tduration\tnomFreq\tactFreq " << endl;
+		vector<burstStep> steps;
+		myBurst.plan(steps);
+		for (size_t k = 0; k < steps.size(); k++)
+		{
+			myBurst.showDetail(steps[k], cout);
+			cout << '\n';
+		}
+		cout.flush();
+		generateMapped(myBurst, steps, myMap.data() + header.size(), numThreads);
+		if (!myMap.close())
+		{
+			cerr << "Failed to write tone bursts to disk." << endl;
+			return -4;
+		}
+		return 0;
 	}
+	
+	// open output file in binary mode, or use standard output
+	// text goes to standard error then, so it never mixes with samples
+	ofstream outfile;
+	if (!piped)
+	{
+		outfile.open(fname, ios::out | ios::binary);
+		if (!outfile)	// test for success
+		{
+			cerr << "Failed to open output file: " << fname << endl;
+			return -2;
+		}
+	}
+#ifdef _WIN32
+	else {_setmode(_fileno(stdout), _O_BINARY);}
+#endif
+	ostream &output = piped ? cout : outfile;
+	ostream &info = piped ? cerr : cout;
 		
-	// write wave file header info to disk
-	// this is brute-force serialization, which
+	// write wave file header info
 	// always writes the same chunks in the same order
-	outfile.write((char *)&myRiff, sizeof(myRiff));
-	outfile.write((char *)&myFmt, sizeof(myFmt));
-	outfile.write((char *)&myData, sizeof(myData));
+	if (!raw)
+	{
+		myRiff.write(output);
+		myFmt.write(output, kind);
+		myData.write(output, kind);
+	}
 	
-	if (outfile.fail())	// test for success
+	if (output.fail())	// test for success
 	{
 		cerr << "Failed to write header info to disk." << endl;
 		return -3;
 	}
 	
-	// show setup info on console
-    cout << "executable:\t" << argv[0]
-	   << "\n arguments:\t" << argc-1
+	// show setup info, and every burst in order, before any are written
+	// so a player reading the samples is never held up by text
+	info << "executable:\t" << exe
+	   << "\n arguments:\t" << numArgs
 	   << "\n file name:\t" << fname << endl;
-	myBurst.showSetup();
-	cout << "numCyc\tduration\tnomFreq\tactFreq " << endl;
+	myBurst.showSetup(info);
+	info << "numCyc\tduration\tnomFreq\tactFreq " << endl;
+	vector<burstStep> steps;
+	myBurst.plan(steps);
+	for (size_t k = 0; k < steps.size(); k++)
+	{
+		myBurst.showDetail(steps[k], info);
+		info << '\n';
+	}
+	info.flush();
 	
-	// wait for one delay time before calculating waveform data
-	long i = 0;
-	short a = 0;
-	for (i = 0; i < myBurst.delay; i++)
+	// generate in the writer's own thread, one block at a time
+	if (queueDepth <= 0)
 	{
-		// write zeroes to both channels during delay
-		outfile.write((char *)&a, 2);
-		outfile.write((char *)&a, 2);
+		bool good = generate(myBurst, BLOCK_SIZE, [&output](vector<char> &block)
+			{return bool(output.write(&block[0], block.size()));});
+		if (!good || !output.flush())
+		{
+			cerr << "Failed to write tone bursts to disk." << endl;
+			return -4;
+		}
+		return 0;
 	}
-
-	// iterate over tone bursts while writing to disk
-	for(myBurst.reset(); myBurst.good(); myBurst.next())
+	
+	// otherwise generate the next blocks while this one is written
+	blockQueue queue(myBurst, BLOCK_SIZE, queueDepth);
+	const vector<char> *block = 0;
+	while ((block = queue.front()) != 0)
 	{
-		// check output file before writing
-		if (outfile.bad())	// test for success
+		if (!output.write(&(*block)[0], block->size()))
 		{
 			cerr << "Failed to write tone bursts to disk." << endl;
 			return -4;
 		}
-		myBurst.write(outfile);
-		myBurst.showDetail();	// show burst info on console
-		cout << endl;
+		queue.pop();
+	}
+	if (!output.flush())
+	{
+		cerr << "Failed to write tone bursts to disk." << endl;
+		return -4;
 	}
 	
 	// report success
 	return 0;
 }
-
-// set data members of RIFF chunk
-void riffChunk::setSize(long theSize)
-{
-	memcpy(chunkID, "RIFF", 4);	// not a null-terminated string
-	chunkSize = theSize + 36;
-	memcpy(format, "WAVE", 4);	// not a null-terminated string
-}
-
-// set data members of fmt chunk
-void fmtChunk::setSize()
-{
-	// assume always 16 bit samples, 2 channel stereo
-	memcpy(chunkID, "fmt ", 4);	// not a null-terminated string
-	chunkSize = 16 ;	// fixed size = 16 for PCM
-	fmtCode = 1;		// code = 1 for PCM
-	numChan = 2;		// number of audio channels
-	sampRate = SAMPLE_RATE;					// sample rate per second
-	byteRate = numChan * sampRate * 2;		// byte rate per second
-	blockAlign = numChan * 2;				// byte count per sample
-	bitsSamp = 16;		// bit count per sample
-}
-
-// set data members of data chunk
-void dataChunk::setSize(long theSize)
-{
-	memcpy(chunkID, "data", 4);	// not a null-terminated string
-	chunkSize = theSize;
-}
@@ -10,10 +10,9 @@
 // on an Apple MacBook Pro with Intel Core Duo processor.
 // Also built (with trivial changes) and tested under MSVC++ 6.0.
 // While it is meant to be easily ported to other environments,
-// it should NOT be considered portable, in that it relies heavily
-// on specific data sizes and struct packing to match the .WAV format.
-// It is meant for Intel byte ordering, and will almost certainly fail
-// if built for Motorola or PPC processors.
+// wave file headers and samples are read and written field by field,
+// in little-endian order, so do not depend on struct packing or on
+// the byte ordering of the host processor.
 //
 // This code is placed in the public domain for the benefit and
 // entertaiment of audio enthusiasts and hobbyists.  Any and all uses
@@ -24,8 +23,33 @@
 #include <iostream>
 #include <fstream>
 #include <complex>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdio>
+#include <map>
+#include <algorithm>
+#include <mutex>
+#include <stdint.h>
 // #include <assert.h>	// uncomment this line for MSVC++ 6.0
 
+// SSE2 is baseline on x86-64, and holds two doubles per register
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define USE_SSE2
+#endif
+
+// platform files needed to map wave files into memory
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 // include the toneBurst class header file
 #include "toneBurst.h"
 
@@ -36,235 +60,2416 @@ toneBurst::toneBurst()
 {
 	// initialize data members
 	sampleRate = SAMPLE_RATE;	// standard audio sample rate
-	duration = 0;
 	interval = INTERVAL;		// burst repetition rate
 	delay = INTERVAL;			// delay one full interval
 	burstMin = BURST_LENGTH;	// minimum burst length 2.27 msec.
-	numBurst = 201;				// 100 bursts per decade
-	burstCount = 0;
+	burstIndex = 0;
 	numAvg = 1;
-	numCycle = 1;			// start with one cycle per burst
-	nominalFreq = 100.0;
-	actualFreq = 0.0;
-	startFreq = 100.0;
-	stopFreq = 10000.0;
-	freqIncr = 1.0;
-	sweep = true;			// default to freq sweep mode
+	perDecade = 0;
+	numTones = 0;
+	logSweep = false;
+	sweepLen = long(SWEEP_SECONDS * SAMPLE_RATE);
+	gateLen = GATE_LENGTH;
+	numHarm = 0;
+	precision = PRECISION_DOUBLE;
+	average = AVERAGE_SUM;
+	welchLen = 0;
+	type = SAMPLE_INT16;	// default to 16 bit stereo
+	numChan = 2;
+	frameSize = 4;
+	init(true);				// default to freq sweep mode
 	
-	// calculate details for first frequency
-	calc();
+	// calculate details for every burst
+	reset();
 }
 
-// only called if user specifies polar mode
+// called by default, or if user specifies polar mode
 void toneBurst::init(bool theSweep)
 {
 	// set data members
 	sweep = theSweep;
 	if (sweep)	// handle frequency sweep case
 	{
-		numBurst = 201;
-		startFreq = 100.0;
-		stopFreq = 10000.0;
+		numBurst = SWEEP_STEPS;
+		startFreq = SWEEP_START;
+		stopFreq = SWEEP_STOP;
 	}
 	else		// handle polar plot case
 	{
-		numBurst = 72;
-		startFreq = 1000.0;
+		numBurst = POLAR_STEPS;
+		startFreq = POLAR_FREQ;
 		stopFreq = startFreq;
 		interval = 2 * INTERVAL;	// allow time to set turntable
 	}
 }
 
+// only called if user specifies log sweep mode
+// one sweep from start to end freq, then half a second for the room to decay
+void toneBurst::initLog(long theLen)
+{
+	sweep = true;
+	logSweep = true;
+	sweepLen = theLen;
+	interval = sweepLen + sampleRate / 2;
+}
+
+// set encoding of sound data to be analyzed
+void toneBurst::setFormat(sampleType theType, long theChan)
+{
+	type = theType;
+	numChan = theChan;
+	frameSize = theChan * ((theType == SAMPLE_INT16) ? 2 :
+		(theType == SAMPLE_INT24) ? 3 : 4);
+}
+
+// set sample rate, keeping burst interval, delay and minimum length the same
+// in time
+// burst lengths follow from the new rate when the table is next built
+void toneBurst::setRate(long theRate)
+{
+	interval = long(double(interval) * theRate / sampleRate);
+	sweepLen = long(double(sweepLen) * theRate / sampleRate);
+	delay = long(double(delay) * theRate / sampleRate);
+	burstMin = long(double(burstMin) * theRate / sampleRate);
+	sampleRate = theRate;
+}
+
+// nominal frequencies of the plan, in order
+// an explicit list wins, then steps per decade, then number of steps
+// sweep frequencies are computed from their index, so long plans do not drift
+void toneBurst::nominals(vector<double> &freqs) const
+{
+	long count = (numBurst > 0) ? numBurst : 1;
+	if (!freqList.empty()) {freqs = freqList; return;}
+	if (sweep && (perDecade > 0) && (startFreq > 0.0) && (stopFreq > 0.0))
+		{count = long(perDecade * fabs(log10(stopFreq / startFreq)) + 0.5) + 1;}
+	freqs.clear();
+	for (long k = 0; k < count; k++)
+	{
+		double theFreq = startFreq;
+		if (sweep && (count > 1))
+			{theFreq = startFreq * pow(stopFreq / startFreq, double(k) / (count - 1));}
+		freqs.push_back(theFreq);
+	}
+}
+
+// round each plan frequency to a whole number of cycles per multitone window
+// frequencies which round to a bin already taken, or above Nyquist, are dropped
+void toneBurst::toneBins(vector<double> &freqs, vector<long> &bins) const
+{
+	vector<double> all;
+	vector<char> used(MULTITONE_SIZE / 2, 0);
+	nominals(all);
+	freqs.clear();
+	bins.clear();
+	for (size_t k = 0; k < all.size(); k++)
+	{
+		long bin = long(all[k] * MULTITONE_SIZE / sampleRate + 0.5);
+		if (bin < 1) {bin = 1;}
+		if ((bin >= MULTITONE_SIZE / 2) || used[bin]) {continue;}
+		used[bin] = 1;
+		freqs.push_back(all[k]);
+		bins.push_back(bin);
+	}
+}
+
+// number of bursts in plan, known before the table is built
+long toneBurst::getCount() const
+{
+	vector<double> freqs;
+	if (logSweep) {return 1;}
+	if (numTones > 1)
+	{
+		vector<long> bins;
+		toneBins(freqs, bins);
+		return ((long)bins.size() + numTones - 1) / numTones;
+	}
+	nominals(freqs);
+	return (long)freqs.size();
+}
+
+// highest harmonic analyzed, zero if harmonics are off
+// only single tone bursts have clear harmonic bins
+long toneBurst::getHarmonics() const
+{
+	if ((numHarm < 2) || (numTones > 1) || logSweep) {return 0;}
+	return (numHarm < MAX_HARMONIC) ? numHarm : MAX_HARMONIC;
+}
+
+// arithmetic used for single tone bursts
+// multitone, log sweep, harmonic analysis and averaging one repetition at a
+// time are always double
+precisionMode toneBurst::getPrecision() const
+{
+	if (getHarmonics() || (numTones > 1) || logSweep) {return PRECISION_DOUBLE;}
+	if (getAverage() != AVERAGE_SUM) {return PRECISION_DOUBLE;}
+	return precision;
+}
+
+// how repetitions are combined
+// only single tone bursts repeated more than once are filtered one at a time
+averageMode toneBurst::getAverage() const
+{
+	if ((numAvg < 2) || (numTones > 1) || logSweep) {return AVERAGE_SUM;}
+	return average;
+}
+
+// frame length for gap noise spectra, zero if off
+// rounded down to a power of two, and only for single tone bursts
+long toneBurst::getWelch() const
+{
+	if ((welchLen < 2) || (numTones > 1) || logSweep) {return 0;}
+	long n = 2;
+	while (2 * n <= welchLen) {n *= 2;}
+	return n;
+}
+
 // always called before analyzing bursts
+// builds the whole plan at once, so any burst may be looked up directly
+// sweep frequencies are computed from their index, so long plans do not drift
 void toneBurst::reset()
 {
-	// set burst count for all modes
-	numCycle = 1;
-	burstCount = numBurst;
-	nominalFreq = startFreq;
-	
-	// handle frequency sweep case
-	if (sweep)
+	vector<double> freqs;
+	table.clear();
+	tones.clear();
+	if (logSweep) {planSweep();}
+	else if (numTones > 1) {planTones();}
+	else
 	{
-		numBurst = 201;
-		stopFreq = 10000;
-		freqIncr = pow(stopFreq/startFreq, 1.0/(numBurst - 1));
+		nominals(freqs);
+		for (size_t k = 0; k < freqs.size(); k++)
+		{
+			table.push_back(calc(freqs[k], (long)k));
+		}
 	}
-	
-	// handle polar plot case
-	else
+	burstIndex = 0;
+}
+
+// group tones into bursts, numTones at a time, in plan order
+// each burst is exactly periodic in its window, so one transform finds all
+// of its tones with no leakage between them
+// Schroeder phases keep the crest factor low, and all tones of a burst share
+// one level, reduced if need be so the peak is no higher than a single tone
+void toneBurst::planTones()
+{
+	long n = MULTITONE_SIZE;
+	vector<double> freqs;
+	vector<long> bins;
+	toneBins(freqs, bins);
+	for (long first = 0; first < (long)bins.size(); first += numTones)
 	{
-		// set up for polar plot
-		numBurst = 72;
-		stopFreq = startFreq;
-		freqIncr = 1.0;
+		long count = (long)bins.size() - first;
+		if (count > numTones) {count = numTones;}
+		long index = (long)table.size();
+		
+		// unit amplitude waveform, to find its peak
+		vector< complex<double> > wave(n);
+		for (long m = 0; m < count; m++)
+			{wave[bins[first + m]] = polar(1.0, -M_PI * m * (m + 1) / count);}
+		fft(wave, true);
+		double peak = 0.0;
+		for (long j = 0; j < n; j++)
+		{
+			if (fabs(n * wave[j].real()) > peak) {peak = fabs(n * wave[j].real());}
+		}
+		double level = AMPLITUDE;
+		if (peak * level > 2.0 * AMPLITUDE) {level = 2.0 * AMPLITUDE / peak;}
+		
+		// each tone is a whole number of cycles in the window
+		for (long m = 0; m < count; m++)
+		{
+			burstStep theTone;
+			theTone.numCycle = bins[first + m];
+			theTone.duration = n;
+			theTone.nominalFreq = freqs[first + m];
+			theTone.actualFreq = 1.0 * sampleRate * theTone.numCycle / n;
+			theTone.factor = 2.0 * M_PI * theTone.numCycle / n;
+			theTone.offset = delay + int64_t(index) * interval * numAvg;
+			theTone.phase = -M_PI * m * (m + 1) / count;
+			theTone.level = level;
+			theTone.firstTone = 0;
+			theTone.numTone = 0;
+			tones.push_back(theTone);
+		}
+		
+		// burst shows its first tone, and where to find the rest
+		burstStep theBurst = tones[first];
+		theBurst.firstTone = first;
+		theBurst.numTone = count;
+		table.push_back(theBurst);
 	}
+}
 
-	// recalculate for specific frequency
-	calc();
+// read an explicit list of frequencies, measured in the order given
+// any white space separates them, returns false unless all are positive
+bool toneBurst::loadList(const char *fname)
+{
+	ifstream infile(fname, ios::in);
+	double theFreq = 0.0;
+	freqList.clear();
+	while (infile >> theFreq)
+	{
+		if (theFreq <= 0.0) {freqList.clear(); return false;}
+		freqList.push_back(theFreq);
+	}
+	return infile.eof() && !freqList.empty();
 }
 
 // tone burst iterator
 bool toneBurst::next()
 {
 	// check if more bursts remain
-	if (burstCount > 0)
-	{
-		if (sweep)
-		{
-			// only update for freq sweep case
-			nominalFreq *= freqIncr;
-			calc();
-		}
-		burstCount--; return true;
-	}
-	else return false;
+	if (burstIndex < (long)table.size()) {burstIndex++;}
+	return good();
 }
 
 // test to see if we are done
 bool toneBurst::good()
 {
 	// check if more bursts remain
-	return (burstCount > 0);
+	return (burstIndex < (long)table.size());
+}
+
+// one burst holds the whole sweep, followed by its decay
+// every bin of the gated response between start and end freq is a row,
+// listed as a tone of that burst
+void toneBurst::planSweep()
+{
+	long n = MULTITONE_SIZE;
+	long first = long(ceil(startFreq * n / sampleRate));
+	long last = long(floor(stopFreq * n / sampleRate));
+	if (first < 1) {first = 1;}
+	if (last >= n / 2) {last = n / 2 - 1;}
+	for (long k = first; k <= last; k++)
+	{
+		burstStep theTone;
+		theTone.numCycle = k;
+		theTone.duration = n;
+		theTone.nominalFreq = 1.0 * sampleRate * k / n;
+		theTone.actualFreq = theTone.nominalFreq;
+		theTone.factor = 2.0 * M_PI * k / n;
+		theTone.offset = delay;
+		theTone.phase = 0.0;
+		theTone.level = AMPLITUDE;
+		theTone.firstTone = 0;
+		theTone.numTone = 0;
+		tones.push_back(theTone);
+	}
+	
+	// the burst itself describes the sweep
+	burstStep theBurst = calc(startFreq, 0);
+	theBurst.duration = sweepLen;
+	theBurst.actualFreq = stopFreq;
+	theBurst.numTone = (long)tones.size();
+	table.push_back(theBurst);
 }
 
-// update data members for a particular frequency
-void toneBurst::calc()
+// calculate details for one burst, at its place in the plan
+burstStep toneBurst::calc(double theFreq, long index) const
 {
+	burstStep theStep;
+	theStep.nominalFreq = theFreq;
+	
 	// find least number of full cycles whose duration exceeds burst minimum
-	while ((sampleRate / nominalFreq) * numCycle < burstMin){numCycle++;}
+	theStep.numCycle = 1;
+	while ((sampleRate / theFreq) * theStep.numCycle < burstMin) {theStep.numCycle++;}
 	
 	// round off (truncate) duration to exact samples
-	duration = long((sampleRate / nominalFreq) * numCycle);
+	theStep.duration = long((sampleRate / theFreq) * theStep.numCycle);
 	
 	// find frequency that exactly fills the duration
-	actualFreq = 1.0 * sampleRate * numCycle / duration;
+	theStep.actualFreq = 1.0 * sampleRate * theStep.numCycle / theStep.duration;
 	
 	// calculate common factor for sine and cosine
-	factor = 2.0 * M_PI * actualFreq / sampleRate;
+	theStep.factor = 2.0 * M_PI * theStep.actualFreq / sampleRate;
+	
+	// bursts follow one delay, back to back with averaging
+	theStep.offset = delay + int64_t(index) * interval * numAvg;
+	theStep.phase = 0.0;
+	theStep.level = AMPLITUDE;
+	theStep.firstTone = 0;
+	theStep.numTone = 0;
+	return theStep;
 }
 
 // show burst parameters on console
 void toneBurst::showDetail()
 {
-	cout << numCycle 
-		<< '\t' << duration
-		<< '\t' << nominalFreq 
-		<< '\t' << actualFreq;
+	showDetail(step());
+}
+
+// show burst parameters for any step, on console by default
+void toneBurst::showDetail(const burstStep &step, ostream &out) const
+{
+	out << step.numCycle 
+		<< '\t' << step.duration
+		<< '\t' << step.nominalFreq 
+		<< '\t' << step.actualFreq;
+}
+
+// get details at current frequency, including location in sound data
+burstStep toneBurst::step()
+{
+	if (burstIndex < (long)table.size()) {return table[burstIndex];}
+	return table.back();
+}
+
+// build the table, and get a copy of every step in order
+// leaves the iterator at its start
+void toneBurst::plan(vector<burstStep> &steps)
+{
+	reset();
+	steps = table;
 }
 
 // show setup info on console
-void toneBurst::showSetup()
+void toneBurst::showSetup(ostream &out) const
 {
-	// show waveform details on console
-	cout << "      mode:\t" << (sweep ? "freq sweep" : "polar plot")
-	   << "\nstart freq:\t" << startFreq
-	   << "\n  end freq:\t" << stopFreq
-	   << "\n num steps:\t" << numBurst
+	// show waveform details on console, by default
+	out << "      mode:\t" << (logSweep ? "log sweep" : !freqList.empty() ? "freq list" :
+			sweep ? "freq sweep" : "polar plot")
+	   << "\nstart freq:\t" << (freqList.empty() ? startFreq : freqList.front())
+	   << "\n  end freq:\t" << (freqList.empty() ? (sweep ? stopFreq : startFreq)
+			: freqList.back())
+	   << "\n num steps:\t" << getCount();
+	if (numTones > 1) {out << "\n     tones:\t" << numTones;}
+	out
 	   << "\n averaging:\t" << numAvg
 	   << "\n     delay:\t" << delay
 	   << "\n  interval:\t" << interval
 	   << endl;
 }
 
-// read tone burst from disk, matched filter technique
-// looks only for the exact frequency being measured
-void toneBurst::read(ifstream &infile)
-{
-	long i = 0, j = 0;		// local loop indices, NOT sqrt(-1)
-	short a1 = 0, a2 = 0;
-	complex<double> sum1(0,0);	// channel 1 response
-	complex<double> sum2(0,0);	// channel 2 response
-	complex<double> sum3(0,0);	// channel 1 background
-	complex<double> sum4(0,0);	// channel 2 background
-	complex<double> cfactor(0, factor);
-	
-	// iterate over averaging, burst interval
-	for (i = 0; i < numAvg; i++)
-	for (j = 0; j < interval; j++)
-	{
-		// read data from both channels
-		infile.read((char *)&a1, 2);
-		infile.read((char *)&a2, 2);
-		
-		// analyze burst response
-		// this is a single frequency discrete Fourier transform
-		// phase angle is referred to start of burst
-		if (j < duration)
+// analyze tone burst in memory, matched filter technique
+// frames point to interleaved sound data, and are advanced past this burst
+// puts burst parameters and results into the sink
+void toneBurst::read(const char *&frames, resultSink &sink)
+{
+	burstResult result;
+	burstStep theStep = step();
+	analyze(theStep, frames, result);
+	sink.put(theStep, result);
+	frames += frameSize * getSpan();
+}
+
+// sample decoders, one per encoding, explicitly little-endian
+// all scale to 16 bit units, so AMPLITUDE means +0 dB for every format
+// getInt() rounds to whole 16 bit units, for fixed point sums
+struct int16Sample
+{
+	static double get(const char *p)
+	{
+		const unsigned char *u = (const unsigned char *)p;
+		return int16_t(u[0] | (u[1] << 8));
+	}
+	static int32_t getInt(const char *p) {return int32_t(get(p));}
+};
+
+struct int24Sample
+{
+	// place 24 bits at top of a 32 bit word to extend the sign
+	static int32_t word(const char *p)
+	{
+		const unsigned char *u = (const unsigned char *)p;
+		return int32_t((uint32_t(u[0]) << 8) | (uint32_t(u[1]) << 16)
+			| (uint32_t(u[2]) << 24));
+	}
+	static double get(const char *p) {return word(p) / 65536.0;}
+	static int32_t getInt(const char *p) {return int32_t((int64_t(word(p)) + 32768) >> 16);}
+};
+
+struct int32Sample
+{
+	static double get(const char *p)
+	{
+		return int32_t(getLE32(p)) / 65536.0;
+	}
+	static int32_t getInt(const char *p)
+	{
+		return int32_t((int64_t(int32_t(getLE32(p))) + 32768) >> 16);
+	}
+};
+
+struct float32Sample
+{
+	static double get(const char *p)
+	{
+		uint32_t bits = getLE32(p);
+		float value = 0.0f;
+		memcpy(&value, &bits, 4);
+		return value * 32768.0;
+	}
+	static int32_t getInt(const char *p) {return int32_t(lrint(get(p)));}
+};
+
+// add a decoded sample to a running sum of any precision
+// fixed point sums hold whole 16 bit units, rounded
+template <class sample>
+static inline void addTo(double &sum, const char *p) {sum += sample::get(p);}
+template <class sample>
+static inline void addTo(float &sum, const char *p) {sum += float(sample::get(p));}
+template <class sample>
+static inline void addTo(int32_t &sum, const char *p) {sum += sample::getInt(p);}
+
+// decode one window of interleaved frames, adding every channel into sums
+// sums are laid out one channel after another, stride apart, so each
+// channel is contiguous for the DFT kernel
+// specialized at compile time, so the inner loop has no format branches
+template <class sample, class sumType>
+static void accumulate(const char *frames, long count, long frameSize,
+	long numChan, sumType *sums, long stride)
+{
+	long sampleSize = frameSize / numChan;
+	for (long j = 0; j < count; j++, frames += frameSize)
+	{
+		const char *p = frames;
+		for (long c = 0; c < numChan; c++, p += sampleSize)
 		{
-			complex<double> ccoeff = exp(cfactor * double(j)); 
-			sum1 += double(a1) * ccoeff;
-			sum2 += double(a2) * ccoeff;
+			addTo<sample>(sums[c * stride + j], p);
 		}
-		
-		// analyze background level, near end of burst interval
-		if ((j < (interval - duration)) && (j >= (interval -  (2 * duration))))
+	}
+}
+
+// single frequency DFT kernel over one window of one channel
+// returns sum of samples times phasor table
+static complex<double> dftChannel(const double *x, long count,
+	const double *cosTab, const double *sinTab)
+{
+	long j = 0;		// local loop index, NOT sqrt(-1)
+#ifdef USE_SSE2
+	// two samples per register, four per pass
+	// separate accumulators hide add latency
+	__m128d re0 = _mm_setzero_pd(), im0 = _mm_setzero_pd();
+	__m128d re1 = _mm_setzero_pd(), im1 = _mm_setzero_pd();
+	for (; j + 3 < count; j += 4)
+	{
+		__m128d x0 = _mm_loadu_pd(x + j);
+		__m128d x1 = _mm_loadu_pd(x + j + 2);
+		re0 = _mm_add_pd(re0, _mm_mul_pd(x0, _mm_loadu_pd(cosTab + j)));
+		im0 = _mm_add_pd(im0, _mm_mul_pd(x0, _mm_loadu_pd(sinTab + j)));
+		re1 = _mm_add_pd(re1, _mm_mul_pd(x1, _mm_loadu_pd(cosTab + j + 2)));
+		im1 = _mm_add_pd(im1, _mm_mul_pd(x1, _mm_loadu_pd(sinTab + j + 2)));
+	}
+	double re[2], im[2];
+	_mm_storeu_pd(re, _mm_add_pd(re0, re1));
+	_mm_storeu_pd(im, _mm_add_pd(im0, im1));
+	double sumRe = re[0] + re[1], sumIm = im[0] + im[1];
+#else
+	double sumRe = 0.0, sumIm = 0.0;
+#endif
+	// remaining samples, or all samples without SSE2
+	for (; j < count; j++)
+	{
+		sumRe += x[j] * cosTab[j];
+		sumIm += x[j] * sinTab[j];
+	}
+	return complex<double>(sumRe, sumIm);
+}
+
+// DFT kernel for several bins over one window of one channel
+// each sample is loaded once, then multiplied by the phasor of every bin
+// tables hold one row of phasors per bin, stride apart
+static void dftBins(const double *x, long count, const double *cosTab,
+	const double *sinTab, long stride, long numBins, complex<double> *out)
+{
+	long j = 0;		// local loop index, NOT sqrt(-1)
+	long b = 0;		// local bin index
+	double sumRe[MAX_HARMONIC], sumIm[MAX_HARMONIC];
+#ifdef USE_SSE2
+	// two samples per register, one accumulator pair per bin
+	__m128d re[MAX_HARMONIC], im[MAX_HARMONIC];
+	for (b = 0; b < numBins; b++) {re[b] = im[b] = _mm_setzero_pd();}
+	for (; j + 1 < count; j += 2)
+	{
+		__m128d x0 = _mm_loadu_pd(x + j);
+		for (b = 0; b < numBins; b++)
+		{
+			re[b] = _mm_add_pd(re[b], _mm_mul_pd(x0, _mm_loadu_pd(cosTab + b * stride + j)));
+			im[b] = _mm_add_pd(im[b], _mm_mul_pd(x0, _mm_loadu_pd(sinTab + b * stride + j)));
+		}
+	}
+	for (b = 0; b < numBins; b++)
+	{
+		double r[2], i[2];
+		_mm_storeu_pd(r, re[b]);
+		_mm_storeu_pd(i, im[b]);
+		sumRe[b] = r[0] + r[1];
+		sumIm[b] = i[0] + i[1];
+	}
+#else
+	for (b = 0; b < numBins; b++) {sumRe[b] = sumIm[b] = 0.0;}
+#endif
+	// remaining sample, or all samples without SSE2
+	for (; j < count; j++)
+	{
+		for (b = 0; b < numBins; b++)
 		{
-			complex<double> ccoeff = exp(cfactor * double(j)); 
-			sum3 += double(a1) * ccoeff;
-			sum4 += double(a2) * ccoeff;
+			sumRe[b] += x[j] * cosTab[b * stride + j];
+			sumIm[b] += x[j] * sinTab[b * stride + j];
 		}
 	}
+	for (b = 0; b < numBins; b++) {out[b] = complex<double>(sumRe[b], sumIm[b]);}
+}
+
+// float DFT kernel over one window of one channel
+// each lane carries the rounding error of its running sum, and feeds it back
+// so long windows lose no more than a few float roundings in all
+static complex<double> dftFloat(const float *x, long count,
+	const float *cosTab, const float *sinTab)
+{
+	long j = 0;		// local loop index, NOT sqrt(-1)
+	double sumRe = 0.0, sumIm = 0.0;
+#ifdef USE_SSE2
+	// four samples per register
+	__m128 re = _mm_setzero_ps(), im = _mm_setzero_ps();
+	__m128 reErr = _mm_setzero_ps(), imErr = _mm_setzero_ps();
+	for (; j + 3 < count; j += 4)
+	{
+		__m128 x0 = _mm_loadu_ps(x + j);
+		__m128 yRe = _mm_sub_ps(_mm_mul_ps(x0, _mm_loadu_ps(cosTab + j)), reErr);
+		__m128 yIm = _mm_sub_ps(_mm_mul_ps(x0, _mm_loadu_ps(sinTab + j)), imErr);
+		__m128 tRe = _mm_add_ps(re, yRe);
+		__m128 tIm = _mm_add_ps(im, yIm);
+		reErr = _mm_sub_ps(_mm_sub_ps(tRe, re), yRe);
+		imErr = _mm_sub_ps(_mm_sub_ps(tIm, im), yIm);
+		re = tRe;
+		im = tIm;
+	}
+	float r[4], i[4], rErr[4], iErr[4];
+	_mm_storeu_ps(r, re);
+	_mm_storeu_ps(i, im);
+	_mm_storeu_ps(rErr, reErr);
+	_mm_storeu_ps(iErr, imErr);
+	for (long k = 0; k < 4; k++)
+	{
+		sumRe += double(r[k]) - rErr[k];
+		sumIm += double(i[k]) - iErr[k];
+	}
 	
-	// factor out sample count and averaging, normalize to +0 dB
-	sum1 /= (duration * numAvg * AMPLITUDE / 2.0);
-	sum2 /= (duration * numAvg * AMPLITUDE / 2.0);
-	sum3 /= (duration * numAvg * AMPLITUDE / 2.0);
-	sum4 /= (duration * numAvg * AMPLITUDE / 2.0);
+	// remaining samples, few enough to add directly
+	for (; j < count; j++)
+	{
+		sumRe += x[j] * cosTab[j];
+		sumIm += x[j] * sinTab[j];
+	}
+#else
+	float re = 0.0f, im = 0.0f, reErr = 0.0f, imErr = 0.0f;
+	for (; j < count; j++)
+	{
+		float yRe = x[j] * cosTab[j] - reErr;
+		float yIm = x[j] * sinTab[j] - imErr;
+		float tRe = re + yRe, tIm = im + yIm;
+		reErr = (tRe - re) - yRe;
+		imErr = (tIm - im) - yIm;
+		re = tRe;
+		im = tIm;
+	}
+	sumRe = re;
+	sumIm = im;
+#endif
+	return complex<double>(sumRe, sumIm);
+}
+
+// fixed point DFT kernel over one window of one channel
+// phasors are scaled integers, chosen by the caller so sums cannot overflow
+// result is still scaled by the phasor scale
+static complex<double> dftFixed(const int32_t *x, long count,
+	const int32_t *cosTab, const int32_t *sinTab)
+{
+	int64_t sumRe = 0, sumIm = 0;
+	for (long j = 0; j < count; j++)
+	{
+		sumRe += int64_t(x[j]) * cosTab[j];
+		sumIm += int64_t(x[j]) * sinTab[j];
+	}
+	return complex<double>(double(sumRe), double(sumIm));
+}
+
+// decode frames of any encoding, adding every channel into sums
+// picks the specialized loop once per call
+template <class sumType>
+static void accumulateAny(sampleType type, const char *frames, long count,
+	long frameSize, long numChan, sumType *sums, long stride)
+{
+	switch (type)
+	{
+		case SAMPLE_INT16:
+			accumulate<int16Sample>(frames, count, frameSize, numChan, sums, stride);
+			break;
+		case SAMPLE_INT24:
+			accumulate<int24Sample>(frames, count, frameSize, numChan, sums, stride);
+			break;
+		case SAMPLE_INT32:
+			accumulate<int32Sample>(frames, count, frameSize, numChan, sums, stride);
+			break;
+		case SAMPLE_FLOAT32:
+			accumulate<float32Sample>(frames, count, frameSize, numChan, sums, stride);
+			break;
+		default:
+			break;
+	}
+}
+
+// sum repetitions of both windows of one burst, every channel, any precision
+// rows are laid out as for analyzeAs, burst window then background window
+template <class sumType>
+static void sumWindows(sampleType type, const char *frames, long numAvg,
+	long interval, long frameSize, long numChan, long burstEnd, long bkgStart,
+	long bkgLen, sumType *respAcc, sumType *bkgAcc)
+{
+	for (long i = 0; i < numAvg; i++, frames += frameSize * interval)
+	{
+		accumulateAny(type, frames, burstEnd, frameSize, numChan,
+			respAcc, burstEnd);
+		accumulateAny(type, frames + frameSize * bkgStart, bkgLen, frameSize,
+			numChan, bkgAcc, bkgLen);
+	}
+}
+
+// sum of complex values held as separate real and imaginary rows
+static complex<double> sumPhasors(const double *re, const double *im, long n)
+{
+	long i = 0;
+#ifdef USE_SSE2
+	__m128d sumRe = _mm_setzero_pd(), sumIm = _mm_setzero_pd();
+	for (; i + 1 < n; i += 2)
+	{
+		sumRe = _mm_add_pd(sumRe, _mm_loadu_pd(re + i));
+		sumIm = _mm_add_pd(sumIm, _mm_loadu_pd(im + i));
+	}
+	double r[2], m[2];
+	_mm_storeu_pd(r, sumRe);
+	_mm_storeu_pd(m, sumIm);
+	double totalRe = r[0] + r[1], totalIm = m[0] + m[1];
+#else
+	double totalRe = 0.0, totalIm = 0.0;
+#endif
+	for (; i < n; i++) {totalRe += re[i]; totalIm += im[i];}
+	return complex<double>(totalRe, totalIm);
+}
+
+// sum of squared distances from center, same layout as sumPhasors()
+static double sumSquares(const double *re, const double *im, long n,
+	complex<double> center)
+{
+	long i = 0;
+	double total = 0.0;
+#ifdef USE_SSE2
+	__m128d cRe = _mm_set1_pd(center.real()), cIm = _mm_set1_pd(center.imag());
+	__m128d sum = _mm_setzero_pd();
+	for (; i + 1 < n; i += 2)
+	{
+		__m128d dRe = _mm_sub_pd(_mm_loadu_pd(re + i), cRe);
+		__m128d dIm = _mm_sub_pd(_mm_loadu_pd(im + i), cIm);
+		sum = _mm_add_pd(sum, _mm_add_pd(_mm_mul_pd(dRe, dRe), _mm_mul_pd(dIm, dIm)));
+	}
+	double t[2];
+	_mm_storeu_pd(t, sum);
+	total = t[0] + t[1];
+#endif
+	for (; i < n; i++) {total += norm(complex<double>(re[i], im[i]) - center);}
+	return total;
+}
+
+// combine the phasors of every repetition of one window of one channel
+// re and im each hold n values, n at least two
+// median is taken separately for real and imaginary parts, so one burst
+// spoiled by an impulse moves it very little
+// for median and trim, repetitions farthest from the median are dropped
+// before the spread is found, and trim averages those kept
+// stdErr is the spread of the repetitions used, about the estimate, divided
+// by the square root of their number, scaled up for the median
+static complex<double> reducePhasors(const double *re, const double *im,
+	long n, averageMode mode, double &stdErr)
+{
+	if (mode == AVERAGE_MEAN)
+	{
+		complex<double> mean = sumPhasors(re, im, n) / double(n);
+		stdErr = sqrt(sumSquares(re, im, n, mean) / (n - 1) / n);
+		return mean;
+	}
 	
-	// report results to console
-	// 0.0 dB reference level when analyzing original generated file
-	cout <<        abs(sum1)						// magnitude channel 1
-		<< '\t' << abs(sum2)						// magnitude channel 2
-		<< '\t' << 20.0*log10(abs(sum1))			// dB channel 1
-		<< '\t' << 20.0*log10(abs(sum2))			// dB channel 2
-		<< '\t' << 20.0*log10(abs(sum1)/abs(sum2))	// dB difference
-		<< '\t' << arg(sum1)						// phase channel 1
-		<< '\t' << arg(sum2)						// phase channel 2
-		<< '\t' << arg(sum1) -arg(sum2)				// phase difference
-		<< '\t' << 20.0*log10(abs(sum3))			// dB background 1
-		<< '\t' << 20.0*log10(abs(sum4))			// dB background 2
-		<< endl;
-	return;
+	// median of each part, from copies, the middle two averaged if n is even
+	static thread_local vector<double> work, dist, sorted;
+	work.assign(re, re + n);
+	work.insert(work.end(), im, im + n);
+	double med[2];
+	for (long k = 0; k < 2; k++)
+	{
+		double *w = &work[k * n];
+		nth_element(w, w + n / 2, w + n);
+		med[k] = w[n / 2];
+		if (!(n % 2)) {med[k] = (med[k] + *max_element(w, w + n / 2)) / 2.0;}
+	}
+	complex<double> median(med[0], med[1]);
+	
+	// keep the repetitions nearest the median, packed in place of the copies
+	long keep = n - long(n * TRIM_FRACTION);
+	if (keep < 2) {keep = 2;}
+	dist.resize(n);
+	for (long i = 0; i < n; i++) {dist[i] = norm(complex<double>(re[i], im[i]) - median);}
+	sorted = dist;
+	nth_element(sorted.begin(), sorted.begin() + (keep - 1), sorted.end());
+	double limit = sorted[keep - 1];
+	long m = 0;
+	for (long i = 0; (i < n) && (m < keep); i++)
+	{
+		if (dist[i] > limit) {continue;}
+		work[m] = re[i];
+		work[n + m] = im[i];
+		m++;
+	}
+	const double *keptRe = &work[0], *keptIm = &work[n];
+	
+	complex<double> center = median;
+	double factor = sqrt(M_PI / 2.0);	// median is noisier than the mean
+	if (mode == AVERAGE_TRIM)
+	{
+		center = sumPhasors(keptRe, keptIm, m) / double(m);
+		factor = 1.0;
+	}
+	stdErr = factor * sqrt(sumSquares(keptRe, keptIm, m, center) / (m - 1) / m);
+	return center;
 }
 
-// write a burst to output stream
-void toneBurst::write(ofstream &outfile)
+// matched filter for one burst, all channels, for one sample encoding
+// repetitions are summed sample by sample first, since the DFT is linear
+// then each window of each channel is transformed once, sharing phasors
+// with harmonics, the burst window finds every bin in that same pass
+//
+// if reps is given, each repetition is transformed on its own instead, and
+// its phasors kept for robust averaging, not summed
+// reps holds one pair of rows of numAvg values, real then imaginary, for
+// each bin of each channel, harmonic-major as for harm, then the background
+template <class sample>
+static void analyzeAs(const char *frames, long numAvg, long interval,
+	long frameSize, long numChan, long burstEnd, long bkgStart, long bkgEnd,
+	const double *cosTab, const double *sinTab, long numBins,
+	complex<double> *resp, complex<double> *bkg, complex<double> *harm,
+	double *reps)
 {
-	long i = 0, j = 0;	// local loop indices, NOT sqrt(-1)
-	short a = 0;
-	double y = 0.0;
+	long c = 0;		// local channel index
+	long bkgLen = (bkgEnd > bkgStart) ? bkgEnd - bkgStart : 0;
 	
-	// iterate over averaging, burst interval, number of channels
-	for (i = 0; i < numAvg; i++)
-	for (j = 0; j < interval; j++)
+	// one contiguous row per channel for each window
+	// kept per thread, so after the first burst of each size nothing is allocated
+	static thread_local vector<double> acc;
+	acc.assign(numChan * (burstEnd + bkgLen) + 1, 0.0);
+	double *respAcc = &acc[0];
+	double *bkgAcc = respAcc + numChan * burstEnd;
+	
+	// iterate over averaging, skipping samples outside the windows
+	// one repetition per pass if each is kept, else all of them in one pass
+	long numPass = reps ? numAvg : 1;
+	long perPass = reps ? 1 : numAvg;
+	for (long pass = 0; pass < numPass; pass++)
 	{
-		// calculate burst waveform
-		if (j < duration)
+		if (pass) {fill(acc.begin(), acc.end(), 0.0);}
+		for (long i = 0; i < perPass; i++, frames += frameSize * interval)
+		{
+			accumulate<sample>(frames, burstEnd, frameSize, numChan,
+				respAcc, burstEnd);
+			accumulate<sample>(frames + frameSize * bkgStart, bkgLen, frameSize,
+				numChan, bkgAcc, bkgLen);
+		}
+		
+		// phasor table starts at zero for both windows
+		for (c = 0; c < numChan; c++)
 		{
-			// raised cosine and second harmonic
-			y = cos(factor * j) - cos(2.0 * factor * j);
+			if (numBins > 1)
+			{
+				complex<double> bins[MAX_HARMONIC];
+				dftBins(respAcc + c * burstEnd, burstEnd, cosTab, sinTab,
+					burstEnd + 1, numBins, bins);
+				resp[c] = bins[0];
+				for (long b = 1; b < numBins; b++) {harm[(b - 1) * numChan + c] = bins[b];}
+			}
+			else {resp[c] = dftChannel(respAcc + c * burstEnd, burstEnd, cosTab, sinTab);}
+			bkg[c] = dftChannel(bkgAcc + c * bkgLen, bkgLen, cosTab, sinTab);
+			if (!reps) {continue;}
 			
-			// normalize to +0 dB amplitude, convert to short word
-			a = short(y * AMPLITUDE);
+			// file this repetition's phasors under each bin, then background
+			for (long b = 0; b <= numBins; b++)
+			{
+				complex<double> z = (b == numBins) ? bkg[c] :
+					(b ? harm[(b - 1) * numChan + c] : resp[c]);
+				double *row = reps + 2 * numAvg * (b * numChan + c);
+				row[pass] = z.real();
+				row[numAvg + pass] = z.imag();
+			}
 		}
-		else
+	}
+}
+
+// analyze any tone burst in memory, matched filter technique
+// looks only for the exact frequency being measured
+// frames point to interleaved sound data at the start of this burst
+// every channel is analyzed in the same pass
+// only reads shared data, so bursts may be analyzed on many threads at once
+//
+// phasors exp(i * factor * j) are tabulated once per burst, using the same
+// cos() and sin() values that exp() would produce, and shared by both windows
+// and all averaging passes.  Against the per-sample exp() reference, results
+// agree within 1e-12 of the +0 dB level in magnitude, and within 1e-12 radians
+// in phase.  This is summation order rounding only, far below the resolution
+// of 16 bit samples.
+void toneBurst::analyze(const burstStep &step, const char *frames,
+	burstResult &result) const
+{
+	long j = 0;		// local loop index, NOT sqrt(-1)
+	long c = 0;		// local channel index
+	long duration = step.duration;
+	double factor = step.factor;
+	if (logSweep) {analyzeSweep(step, frames, result); return;}
+	if (step.numTone > 0) {analyzeTones(step, frames, result); return;}
+	if (getPrecision() != PRECISION_DOUBLE)
+	{
+		analyzeReduced(step, frames, result);
+		analyzeGap(step, frames, result);
+		return;
+	}
+	result.resp.assign(numChan, complex<double>(0,0));
+	result.bkg.assign(numChan, complex<double>(0,0));
+	
+	// harmonics at or above half the sample rate are left at zero
+	long numHarm = getHarmonics();
+	long numBins = numHarm ? numHarm : 1;
+	while ((numBins > 1) && (factor * numBins >= M_PI)) {numBins--;}
+	result.harm.assign(numHarm ? (numHarm - 1) * numChan : 0, complex<double>(0,0));
+	
+	// background window sits just before the end of each interval
+	long burstEnd = (duration < interval) ? duration : interval;
+	long bkgStart = interval - 2 * duration;
+	long bkgEnd = interval - duration;
+	if (bkgStart < 0) {bkgStart = 0;}
+	
+	// tabulate phasors for one burst duration, one spare entry so never empty
+	// one row for the fundamental, then one for each harmonic
+	long stride = burstEnd + 1;
+	static thread_local vector<double> cosTab, sinTab;
+	cosTab.assign(stride * numBins, 0.0);
+	sinTab.assign(stride * numBins, 0.0);
+	for (long b = 0; b < numBins; b++)
+	for (j = 0; j < burstEnd; j++)
+	{
+		cosTab[b * stride + j] = cos(factor * (b + 1) * j);
+		sinTab[b * stride + j] = sin(factor * (b + 1) * j);
+	}
+	
+	// rows for the phasors of each repetition, if they are kept
+	averageMode mode = getAverage();
+	static thread_local vector<double> keep;
+	double *reps = 0;
+	if (mode != AVERAGE_SUM)
+	{
+		keep.resize(2 * numAvg * numChan * (numBins + 1));
+		reps = &keep[0];
+	}
+	
+	// pick a decoder once per burst, not once per sample
+	complex<double> *resp = &result.resp[0];
+	complex<double> *bkg = &result.bkg[0];
+	complex<double> *harm = numHarm ? &result.harm[0] : 0;
+	switch (type)
+	{
+		case SAMPLE_INT16:
+			analyzeAs<int16Sample>(frames, numAvg, interval, frameSize, numChan,
+				burstEnd, bkgStart, bkgEnd, &cosTab[0], &sinTab[0], numBins,
+				resp, bkg, harm, reps);
+			break;
+		case SAMPLE_INT24:
+			analyzeAs<int24Sample>(frames, numAvg, interval, frameSize, numChan,
+				burstEnd, bkgStart, bkgEnd, &cosTab[0], &sinTab[0], numBins,
+				resp, bkg, harm, reps);
+			break;
+		case SAMPLE_INT32:
+			analyzeAs<int32Sample>(frames, numAvg, interval, frameSize, numChan,
+				burstEnd, bkgStart, bkgEnd, &cosTab[0], &sinTab[0], numBins,
+				resp, bkg, harm, reps);
+			break;
+		case SAMPLE_FLOAT32:
+			analyzeAs<float32Sample>(frames, numAvg, interval, frameSize, numChan,
+				burstEnd, bkgStart, bkgEnd, &cosTab[0], &sinTab[0], numBins,
+				resp, bkg, harm, reps);
+			break;
+		default:
+			break;
+	}
+	
+	// reduce the repetitions of every bin, scaled up to match a sum of them
+	// each response keeps the standard error of its reduction
+	result.noise.clear();
+	if (reps)
+	{
+		result.noise.assign(numChan, 0.0);
+		for (long b = 0; b <= numBins; b++)
+		for (c = 0; c < numChan; c++)
 		{
-			a = 0;	// write silence between bursts
+			const double *row = reps + 2 * numAvg * (b * numChan + c);
+			double stdErr = 0.0;
+			complex<double> z = double(numAvg) *
+				reducePhasors(row, row + numAvg, numAvg, mode, stdErr);
+			if (b == numBins) {bkg[c] = z;}
+			else if (b) {harm[(b - 1) * numChan + c] = z;}
+			else {resp[c] = z; result.noise[c] = numAvg * stdErr;}
 		}
+	}
+	
+	// refer background phase to start of burst, same as exp(i * factor * j)
+	// factor out sample count and averaging, normalize to +0 dB
+	complex<double> rotate(cos(factor * bkgStart), sin(factor * bkgStart));
+	double scale = duration * numAvg * AMPLITUDE / 2.0;
+	for (c = 0; c < numChan; c++)
+	{
+		resp[c] /= scale;
+		bkg[c] *= rotate / scale;
+	}
+	for (c = 0; c < (long)result.noise.size(); c++) {result.noise[c] /= scale;}
+	analyzeGap(step, frames, result);
+	for (j = 0; j < (long)result.harm.size(); j++) {harm[j] /= scale;}
+}
 
-		// write the same data to both channels, for now
-		outfile.write((char *)&a, 2);
-		outfile.write((char *)&a, 2);
+// noise spectrum of the silent gap after every repetition of one burst
+// the gap leaves one burst duration for the burst to die away, and one before
+// the next burst, the same margin the background window keeps
+// Welch's method: Hann windowed frames, overlapped by half, whose power
+// spectra are averaged over every frame of every repetition
+// samples are decoded from the frames already in memory for the matched
+// filter, so the capture is still read only once
+//
+// result.gap holds each channel's noise as the matched filter would find it
+// at this burst's frequency, same units as bkg, from the spectrum there
+// then each channel's spectrum, welchLen / 2 + 1 bins, as mean power per
+// sample in squared 16 bit units, so white noise reads as its variance
+void toneBurst::analyzeGap(const burstStep &step, const char *frames,
+	burstResult &result) const
+{
+	long j = 0;		// local loop index, NOT sqrt(-1)
+	long c = 0;		// local channel index
+	long n = getWelch();
+	long numBins = n / 2 + 1;
+	result.gap.clear();
+	if (!n) {return;}
+	result.gap.assign(numChan * (numBins + 1), 0.0);
+	
+	// gap in each interval, and the frames which fit in it
+	long duration = step.duration;
+	long gapStart = 2 * ((duration < interval) ? duration : interval);
+	long gapLen = interval - duration - gapStart;
+	long hop = n / 2;
+	long numFrames = (gapLen >= n) ? (gapLen - n) / hop + 1 : 0;
+	if (!numFrames) {return;}
+	
+	// window is the same for every burst, so built once per thread
+	static thread_local vector<double> window, rows, x;
+	static thread_local vector< complex<double> > spec;
+	static thread_local double windowPower = 0.0;
+	if ((long)window.size() != n)
+	{
+		window.resize(n);
+		windowPower = 0.0;
+		for (j = 0; j < n; j++)
+		{
+			window[j] = 0.5 - 0.5 * cos(2.0 * M_PI * j / n);
+			windowPower += window[j] * window[j];
+		}
+	}
+	x.resize(n);
+	
+	// one row per channel for the gap of each repetition, in turn
+	double *psd = &result.gap[numChan];
+	frames += frameSize * gapStart;
+	for (long i = 0; i < numAvg; i++, frames += frameSize * interval)
+	{
+		rows.assign(numChan * gapLen, 0.0);
+		accumulateAny(type, frames, gapLen, frameSize, numChan, &rows[0], gapLen);
+		for (c = 0; c < numChan; c++)
+		for (long f = 0; f < numFrames; f++)
+		{
+			const double *row = &rows[c * gapLen + f * hop];
+			for (j = 0; j < n; j++) {x[j] = row[j] * window[j];}
+			realFft(x, spec);
+			for (j = 0; j < numBins; j++) {psd[c * numBins + j] += norm(spec[j]);}
+		}
+	}
+	
+	// mean power per sample, then the matched filter's share at this burst's
+	// frequency, normalized to +0 dB like the response
+	long bin = lrint(step.actualFreq * n / sampleRate);
+	if (bin > n / 2) {bin = n / 2;}
+	double scale = double(numAvg) * numFrames * windowPower;
+	for (j = 0; j < numChan * numBins; j++) {psd[j] /= scale;}
+	for (c = 0; c < numChan; c++)
+	{
+		result.gap[c] = sqrt(psd[c * numBins + bin] / (double(duration) * numAvg)) /
+			(AMPLITUDE / 2.0);
 	}
-	return;
 }
 
-// get byte count for sound data in wave file
-long toneBurst::getSize()
+// single tone matched filter in float or fixed point
+// same windows, phase reference and normalization as analyze()
+// rows are half the size of double rows, so half the memory traffic
+//
+// err bounds the difference from the double kernel, to first order
+//   float: each phasor, each product and each row entry rounds by at most
+//     one part in 2^24 of its sample, and the running error terms leave at
+//     most two roundings of the total
+//   fixed: each phasor rounds by half a step of its scale, and rows round
+//     each wider sample to whole 16 bit units
+// both real and imaginary parts err this way, so the bound is sqrt(2) larger
+void toneBurst::analyzeReduced(const burstStep &step, const char *frames,
+	burstResult &result) const
 {
-	// bytes/sample * num channels * (samples/burst * averaging * num bursts + delay)
-	// always assumes 2 byte samples, 2 channel stereo
-	return (2 * 2 * (interval * numAvg * numBurst + delay));
+	long j = 0;		// local loop index, NOT sqrt(-1)
+	long c = 0;		// local channel index
+	long duration = step.duration;
+	double factor = step.factor;
+	result.resp.assign(numChan, complex<double>(0,0));
+	result.bkg.assign(numChan, complex<double>(0,0));
+	result.err.assign(numChan, 0.0);
+	
+	// background window sits just before the end of each interval
+	long burstEnd = (duration < interval) ? duration : interval;
+	long bkgStart = interval - 2 * duration;
+	long bkgEnd = interval - duration;
+	if (bkgStart < 0) {bkgStart = 0;}
+	long bkgLen = (bkgEnd > bkgStart) ? bkgEnd - bkgStart : 0;
+	long rowLen = burstEnd + bkgLen;
+	
+	if (precision == PRECISION_FLOAT)
+	{
+		static thread_local vector<float> acc;
+		acc.assign(numChan * rowLen + 1, 0.0f);
+		sumWindows(type, frames, numAvg, interval, frameSize, numChan,
+			burstEnd, bkgStart, bkgLen, &acc[0], &acc[numChan * burstEnd]);
+		static thread_local vector<float> cosTab, sinTab;
+		cosTab.assign(burstEnd + 1, 0.0f);
+		sinTab.assign(burstEnd + 1, 0.0f);
+		for (j = 0; j < burstEnd; j++)
+		{
+			cosTab[j] = float(cos(factor * j));
+			sinTab[j] = float(sin(factor * j));
+		}
+		double u = ldexp(1.0, -24);		// float rounding unit
+		for (c = 0; c < numChan; c++)
+		{
+			const float *row = &acc[c * burstEnd];
+			const float *bkgRow = &acc[numChan * burstEnd + c * bkgLen];
+			result.resp[c] = dftFloat(row, burstEnd, &cosTab[0], &sinTab[0]);
+			result.bkg[c] = dftFloat(bkgRow, bkgLen, &cosTab[0], &sinTab[0]);
+			double absSum = 0.0;
+			for (j = 0; j < burstEnd; j++) {absSum += fabs(row[j]);}
+			result.err[c] = sqrt(2.0) * u * (3.0 * absSum + 2.0 * abs(result.resp[c]));
+		}
+	}
+	else
+	{
+		static thread_local vector<int32_t> acc;
+		acc.assign(numChan * rowLen + 1, 0);
+		sumWindows(type, frames, numAvg, interval, frameSize, numChan,
+			burstEnd, bkgStart, bkgLen, &acc[0], &acc[numChan * burstEnd]);
+		
+		// largest phasor scale whose products, summed over the window, fit
+		// in 63 bits, given full scale samples summed over every repetition
+		int sampleBits = 0, countBits = 0;
+		frexp(32768.0 * numAvg, &sampleBits);
+		frexp(double(burstEnd + 1), &countBits);
+		int bits = 62 - sampleBits - countBits;
+		if (bits > 30) {bits = 30;}
+		double unit = ldexp(1.0, bits);
+		static thread_local vector<int32_t> cosTab, sinTab;
+		cosTab.assign(burstEnd + 1, 0);
+		sinTab.assign(burstEnd + 1, 0);
+		for (j = 0; j < burstEnd; j++)
+		{
+			cosTab[j] = int32_t(lrint(cos(factor * j) * unit));
+			sinTab[j] = int32_t(lrint(sin(factor * j) * unit));
+		}
+		double rowErr = (type == SAMPLE_INT16) ? 0.0 : 0.5 * numAvg;
+		for (c = 0; c < numChan; c++)
+		{
+			const int32_t *row = &acc[c * burstEnd];
+			const int32_t *bkgRow = &acc[numChan * burstEnd + c * bkgLen];
+			result.resp[c] = dftFixed(row, burstEnd, &cosTab[0], &sinTab[0]) / unit;
+			result.bkg[c] = dftFixed(bkgRow, bkgLen, &cosTab[0], &sinTab[0]) / unit;
+			double absSum = 0.0;
+			for (j = 0; j < burstEnd; j++) {absSum += fabs(double(row[j]));}
+			result.err[c] = sqrt(2.0) * (0.5 / unit * absSum + rowErr * burstEnd);
+		}
+	}
+	
+	// refer background phase to start of burst, normalize to +0 dB
+	complex<double> rotate(cos(factor * bkgStart), sin(factor * bkgStart));
+	double scale = duration * numAvg * AMPLITUDE / 2.0;
+	for (c = 0; c < numChan; c++)
+	{
+		result.resp[c] /= scale;
+		result.bkg[c] *= rotate / scale;
+		result.err[c] /= scale;
+	}
 }
 
+// analyze every planned burst which is complete in caller-owned frames
+// frames start where the capture starts, so each burst is found at its own
+// offset, after the delay; samples are read in place, never copied
+// results hold getCount() entries, and reusing them from one capture to the
+// next keeps their storage, so repeated calls allocate nothing
+// returns the number of bursts analyzed, always the first ones in plan order
+long toneBurst::analyzeFrames(const char *frames, int64_t numFrames,
+	burstResult *results) const
+{
+	long k = 0;
+	for (; k < (long)table.size(); k++)
+	{
+		if (table[k].offset + getSpan() > numFrames) {break;}
+		analyze(table[k], frames + size_t(frameSize) * table[k].offset, results[k]);
+	}
+	return k;
+}
+
+// analyze a multitone burst, finding every tone at once
+// repetitions are summed first, then each window is transformed once per pair
+// of channels, packed as real and imaginary parts
+// results are normalized and phase referenced the same as for single tones
+void toneBurst::analyzeTones(const burstStep &step, const char *frames,
+	burstResult &result) const
+{
+	long j = 0;		// local loop index, NOT sqrt(-1)
+	long c = 0;		// local channel index
+	long n = step.duration;
+	long numTone = step.numTone;
+	result.resp.assign(numTone * numChan, complex<double>(0,0));
+	result.bkg.assign(numTone * numChan, complex<double>(0,0));
+	
+	// background window ends where the next burst starts, since one window
+	// before that would overlap this burst, and is zero padded if short
+	long burstEnd = (n < interval) ? n : interval;
+	long bkgStart = interval - n;
+	long bkgEnd = interval;
+	if (bkgStart < burstEnd) {bkgStart = burstEnd;}
+	long bkgLen = bkgEnd - bkgStart;
+	
+	// one row per channel for each window, kept per thread like analyzeAs
+	static thread_local vector<double> acc;
+	acc.assign(2 * numChan * n, 0.0);
+	for (long i = 0; i < numAvg; i++, frames += frameSize * interval)
+	{
+		accumulateAny(type, frames, burstEnd, frameSize, numChan, &acc[0], n);
+		accumulateAny(type, frames + frameSize * bkgStart, bkgLen, frameSize,
+			numChan, &acc[numChan * n], n);
+	}
+	
+	// matched filter sums x * exp(i * factor * j), the conjugate of the
+	// forward transform, then undoes each tone's level and starting phase
+	double scale = n * numAvg / 2.0;
+	static thread_local vector< complex<double> > z;
+	z.resize(n);
+	for (long w = 0; w < 2; w++)
+	for (c = 0; c < numChan; c += 2)
+	{
+		const double *a = &acc[(w * numChan + c) * n];
+		bool pair = (c + 1 < numChan);
+		for (j = 0; j < n; j++) {z[j] = complex<double>(a[j], pair ? a[j + n] : 0.0);}
+		fft(z, false);
+		complex<double> *out = w ? &result.bkg[0] : &result.resp[0];
+		for (long t = 0; t < numTone; t++)
+		{
+			const burstStep &theTone = tones[step.firstTone + t];
+			long k = theTone.numCycle;
+			complex<double> zk = z[k], zn = conj(z[n - k]);
+			complex<double> ref = polar(1.0, theTone.phase) / (scale * theTone.level);
+			if (w) {ref *= polar(1.0, theTone.factor * bkgStart);}
+			out[t * numChan + c] = conj((zk + zn) / 2.0) * ref;
+			if (pair) {out[t * numChan + c + 1] = conj((zk - zn) / complex<double>(0, 2)) * ref;}
+		}
+	}
+}
+
+// deconvolve a log sweep, then gate its impulse response and transform that
+// repetitions are summed first, then each channel is divided by the sweep
+// in the frequency domain, regularized so bins outside the sweep stay quiet
+// the gate keeps a little before time zero, for ringing of the band limits
+// background is the same gate, halfway round the circular response, which
+// lies after the decay and before the harmonics at negative time
+// results are normalized and phase referenced the same as for tone bursts
+void toneBurst::analyzeSweep(const burstStep &step, const char *frames,
+	burstResult &result) const
+{
+	long j = 0;		// local loop index, NOT sqrt(-1)
+	long c = 0;		// local channel index
+	long numTone = step.numTone;
+	long m = MULTITONE_SIZE;
+	long gate = (gateLen < m) ? gateLen : m;
+	long pre = gate / 16;
+	result.resp.assign(numTone * numChan, complex<double>(0,0));
+	result.bkg.assign(numTone * numChan, complex<double>(0,0));
+	
+	// transform covers one interval, sweep and decay
+	long n = 1;
+	while (n < interval) {n <<= 1;}
+	vector<double> acc(numChan * n, 0.0);
+	for (long i = 0; i < numAvg; i++, frames += frameSize * interval)
+	{
+		accumulateAny(type, frames, interval, frameSize, numChan, &acc[0], n);
+	}
+	
+	// reference sweep, exactly as generated
+	vector<double> x(n, 0.0), y;
+	synth(step, y);
+	for (j = 0; j < (long)y.size(); j++) {x[j] = y[j];}
+	vector< complex<double> > sweepSpec, spec;
+	realFft(x, sweepSpec);
+	double peak = 0.0;
+	for (j = 0; j < (long)sweepSpec.size(); j++)
+	{
+		if (norm(sweepSpec[j]) > peak) {peak = norm(sweepSpec[j]);}
+	}
+	double floor = 1e-9 * peak;
+	
+	vector<double> row(n), h, g(m);
+	for (c = 0; c < numChan; c++)
+	{
+		// impulse response by regularized division
+		row.assign(&acc[c * n], &acc[(c + 1) * n]);
+		realFft(row, spec);
+		for (j = 0; j < (long)spec.size(); j++)
+		{
+			spec[j] *= conj(sweepSpec[j]) / ((norm(sweepSpec[j]) + floor) * numAvg);
+		}
+		realIfft(spec, h);
+		
+		// gate at time zero, and again halfway round for background
+		for (long w = 0; w < 2; w++)
+		{
+			long base = w ? n / 2 : 0;
+			g.assign(m, 0.0);
+			for (j = -pre; j < gate - pre; j++) {g[(j + m) % m] = h[(base + j + n) % n];}
+			realFft(g, spec);
+			
+			// matched filter sums x * exp(i * factor * j), the conjugate
+			complex<double> *out = w ? &result.bkg[0] : &result.resp[0];
+			for (long t = 0; t < numTone; t++)
+			{
+				out[t * numChan + c] = conj(spec[tones[step.firstTone + t].numCycle]);
+			}
+		}
+	}
+}
+
+// key for reusing this burst's results
+// content covers exactly the samples analyze() reads: both windows of each
+// repetition for single tone bursts, or whole intervals otherwise, and also
+// when the gap between bursts is read for its noise spectrum
+// params cover the burst, the input format and every analysis setting
+cacheKey toneBurst::getKey(const burstStep &step, const char *frames) const
+{
+	cacheKey key;
+	long duration = step.duration;
+	long burstEnd = (duration < interval) ? duration : interval;
+	long bkgStart = interval - 2 * duration;
+	long bkgEnd = interval - duration;
+	if (bkgStart < 0) {bkgStart = 0;}
+	long bkgLen = (bkgEnd > bkgStart) ? bkgEnd - bkgStart : 0;
+	bool whole = logSweep || (step.numTone > 0) || getWelch();
+	
+	uint64_t h = 0;
+	for (long i = 0; i < numAvg; i++, frames += frameSize * interval)
+	{
+		if (whole) {h = hashBytes(frames, size_t(frameSize) * interval, h); continue;}
+		h = hashBytes(frames, size_t(frameSize) * burstEnd, h);
+		h = hashBytes(frames + frameSize * bkgStart, size_t(frameSize) * bkgLen, h);
+	}
+	key.content = h;
+	
+	// parameters in a fixed order, then every tone of a multitone burst
+	// plan-wide settings only matter to the log sweep, which uses them for its
+	// deconvolution, so a burst keeps its results when the range changes
+	double p[] = {double(delay), double(interval), double(numAvg),
+		double(duration), step.actualFreq, double(step.numCycle), step.factor,
+		step.phase, step.level, double(sampleRate), double(numChan),
+		double(type), double(getPrecision()), double(getHarmonics()),
+		double(logSweep), double(step.numTone)};
+	h = hashBytes((const char *)p, sizeof(p), 1);
+	if (logSweep)
+	{
+		double q[] = {double(sweepLen), double(gateLen), startFreq, stopFreq};
+		h = hashBytes((const char *)q, sizeof(q), h);
+	}
+	if (getAverage() != AVERAGE_SUM)
+	{
+		double a = double(getAverage());
+		h = hashBytes((const char *)&a, sizeof(a), h);
+	}
+	if (getWelch())
+	{
+		double w = double(getWelch());
+		h = hashBytes((const char *)&w, sizeof(w), h);
+	}
+	for (long t = 0; t < step.numTone; t++)
+	{
+		const burstStep &theTone = tones[step.firstTone + t];
+		double q[] = {double(theTone.numCycle), theTone.phase, theTone.level};
+		h = hashBytes((const char *)q, sizeof(q), h);
+	}
+	key.params = h;
+	return key;
+}
+
+// show column headings, on console by default, matching the lines below
+void toneBurst::showHeading(ostream &out, char sep) const
+{
+	long a = 0, b = 0;	// local channel indices
+	out << "numCyc" << sep << "duration" << sep << "nomFreq" << sep << "actFreq";
+	for (a = 0; a < numChan; a++) {out << sep << "abs " << a + 1;}
+	for (a = 0; a < numChan; a++) {out << sep << "dB " << a + 1;}
+	for (a = 0; a < numChan; a++)
+	for (b = a + 1; b < numChan; b++)
+	{
+		if (numChan == 2) {out << sep << "dB diff";}
+		else {out << sep << "dB " << a + 1 << '-' << b + 1;}
+	}
+	for (a = 0; a < numChan; a++) {out << sep << "phase " << a + 1;}
+	for (a = 0; a < numChan; a++)
+	for (b = a + 1; b < numChan; b++)
+	{
+		if (numChan == 2) {out << sep << "phase diff";}
+		else {out << sep << "phase " << a + 1 << '-' << b + 1;}
+	}
+	for (a = 0; a < numChan; a++) {out << sep << "bkg " << a + 1;}
+	if (getPrecision() != PRECISION_DOUBLE)
+	{
+		for (a = 0; a < numChan; a++) {out << sep << "err " << a + 1;}
+	}
+	if (getAverage() != AVERAGE_SUM)
+	{
+		for (a = 0; a < numChan; a++) {out << sep << "noise " << a + 1;}
+	}
+	if (getWelch())
+	{
+		for (a = 0; a < numChan; a++) {out << sep << "snr " << a + 1;}
+	}
+	if (getHarmonics())
+	{
+		for (a = 0; a < numChan; a++) {out << sep << "thd " << a + 1;}
+		for (long h = 2; h <= getHarmonics(); h++)
+		for (a = 0; a < numChan; a++) {out << sep << 'h' << h << ' ' << a + 1;}
+	}
+	out << endl;
+}
+
+// get analysis results as shown, in the same order as the headings
+// each channel in turn, then each pair of channels
+void toneBurst::getColumns(const burstResult &result, vector<double> &cols) const
+{
+	long a = 0, b = 0;	// local channel indices
+	long n = (long)result.resp.size();
+	const complex<double> *sum = &result.resp[0];
+	const complex<double> *bkg = &result.bkg[0];
+	
+	// 0.0 dB reference level when analyzing original generated file
+	cols.clear();
+	for (a = 0; a < n; a++)		// magnitude each channel
+		{cols.push_back(abs(sum[a]));}
+	for (a = 0; a < n; a++)		// dB each channel
+		{cols.push_back(20.0*log10(abs(sum[a])));}
+	for (a = 0; a < n; a++)		// dB difference each pair
+	for (b = a + 1; b < n; b++)
+		{cols.push_back(20.0*log10(abs(sum[a])/abs(sum[b])));}
+	for (a = 0; a < n; a++)		// phase each channel
+		{cols.push_back(arg(sum[a]));}
+	for (a = 0; a < n; a++)		// phase difference each pair
+	for (b = a + 1; b < n; b++)
+		{cols.push_back(arg(sum[a]) - arg(sum[b]));}
+	for (a = 0; a < n; a++)		// dB background each channel
+		{cols.push_back(20.0*log10(abs(bkg[a])));}
+	for (a = 0; a < (long)result.err.size(); a++)	// dB error bound each channel
+		{cols.push_back(20.0*log10(result.err[a]));}
+	for (a = 0; a < (long)result.noise.size(); a++)	// dB standard error each channel
+		{cols.push_back(20.0*log10(result.noise[a]));}
+	for (a = 0; a < n && !result.gap.empty(); a++)	// dB above gap noise each channel
+		{cols.push_back(20.0*log10(abs(sum[a])/result.gap[a]));}
+	if (result.harm.empty()) {return;}
+	
+	// harmonics in dB below the fundamental
+	// every burst carries its own second harmonic, so THD starts at the third
+	long numHarm = (long)result.harm.size() / n + 1;
+	const complex<double> *harm = &result.harm[0];
+	for (a = 0; a < n; a++)		// THD each channel
+	{
+		double power = 0.0;
+		for (long h = 3; h <= numHarm; h++) {power += norm(harm[(h - 2) * n + a]);}
+		cols.push_back(10.0*log10(power/norm(sum[a])));
+	}
+	for (long h = 2; h <= numHarm; h++)		// each harmonic each channel
+	for (a = 0; a < n; a++)
+		{cols.push_back(20.0*log10(abs(harm[(h - 2) * n + a])/abs(sum[a])));}
+}
+
+// show analysis results, on console by default, completing one line
+// line is ended without flushing, so many lines go out in one write
+void toneBurst::showResult(const burstResult &result, ostream &out) const
+{
+	vector<double> cols;
+	getColumns(result, cols);
+	for (size_t k = 0; k < cols.size(); k++)
+		{out << (k ? "\t" : "") << cols[k];}
+	out << '\n';
+}
+
+// result sink writes to any stream, in any format
+resultSink::resultSink(const toneBurst &theBurst, sinkFormat theFormat,
+	ostream &theOut, const char *theTag)
+	: burst(theBurst), format(theFormat), out(theOut), tag(theTag)
+{
+	numChan = burst.getChannels();
+	numRows = 0;
+	start = burst.delay;
+	noiseOut = 0;
+	numSpectra = 0;
+}
+
+// show column headings for text formats, with a heading for the tag column
+void resultSink::showHeading(const char *tagHead)
+{
+	char sep = (format == SINK_CSV) ? ',' : '\t';
+	if (!isText()) {return;}
+	if (tagHead) {out << tagHead << sep;}
+	burst.showHeading(out, sep);
+}
+
+// note where the first burst was found
+// binary formats keep it in the header, text rows are left as they are
+void resultSink::setOnset(double onset)
+{
+	start = onset;
+}
+
+// add results for one burst, in plan order
+// multitone bursts add one row per tone
+void resultSink::put(const burstStep &step, const burstResult &result)
+{
+	// gap noise spectra are summed for the whole capture
+	if (noiseOut && (result.gap.size() > size_t(numChan)))
+	{
+		spectrum.resize(result.gap.size() - numChan, 0.0);
+		for (size_t k = 0; k < spectrum.size(); k++) {spectrum[k] += result.gap[numChan + k];}
+		numSpectra++;
+	}
+	if (step.numTone == 0) {putRow(step, result); return;}
+	burstResult one;
+	for (long t = 0; t < step.numTone; t++)
+	{
+		one.resp.assign(&result.resp[t * numChan], &result.resp[(t + 1) * numChan]);
+		one.bkg.assign(&result.bkg[t * numChan], &result.bkg[(t + 1) * numChan]);
+		putRow(burst.getTone(step.firstTone + t), one);
+	}
+}
+
+// add one row of results
+void resultSink::putRow(const burstStep &step, const burstResult &result)
+{
+	char field[32];		// one formatted csv field
+	long c = 0;			// local channel index
+	
+	numRows++;
+	switch (format)
+	{
+		case SINK_TEXT:
+			if (tag) {out << tag << '\t';}
+			burst.showDetail(step, out);
+			out << '\t';
+			burst.showResult(result, out);
+			break;
+			
+		case SINK_CSV:
+			// same fields and precision as text, without stream overhead
+			burst.getColumns(result, cols);
+			if (tag) {text += tag; text += ',';}
+			snprintf(field, sizeof(field), "%ld,%ld,%g,%g", step.numCycle,
+				step.duration, step.nominalFreq, step.actualFreq);
+			text += field;
+			for (size_t k = 0; k < cols.size(); k++)
+			{
+				snprintf(field, sizeof(field), ",%g", cols[k]);
+				text += field;
+			}
+			text += '\n';
+			if (text.size() >= 65536) {out.write(text.data(), text.size()); text.clear();}
+			break;
+			
+		case SINK_RECORDS:
+		case SINK_COLUMNS:
+		{
+			// fixed layout, every field 4 bytes
+			size_t k = rows.size();
+			rows.resize(k + getRowSize());
+			char *p = &rows[k];
+			putLE32(p, uint32_t(step.numCycle));
+			putLE32(p + 4, uint32_t(step.duration));
+			putLEfloat(p + 8, float(step.nominalFreq));
+			putLEfloat(p + 12, float(step.actualFreq));
+			for (c = 0, p += 16; c < numChan; c++, p += 12)
+			{
+				putLEfloat(p, float(abs(result.resp[c])));
+				putLEfloat(p + 4, float(arg(result.resp[c])));
+				putLEfloat(p + 8, float(abs(result.bkg[c])));
+			}
+			
+			// THD from the third harmonic up, then each harmonic, as ratios
+			long numHarm = burst.getHarmonics();
+			for (c = 0; c < numChan && numHarm; c++)
+			{
+				double fund = abs(result.resp[c]), power = 0.0;
+				const complex<double> *harm = &result.harm[c];
+				for (long h = 3; h <= numHarm; h++) {power += norm(harm[(h - 2) * numChan]);}
+				putLEfloat(p, float(sqrt(power) / fund));
+				for (long h = 2; h <= numHarm; h++)
+					{putLEfloat(p + 4 * (h - 1), float(abs(harm[(h - 2) * numChan]) / fund));}
+				p += 4 * numHarm;
+			}
+			for (c = 0; c < (long)result.err.size(); c++, p += 4)
+				{putLEfloat(p, float(result.err[c]));}
+			for (c = 0; c < (long)result.noise.size(); c++, p += 4)
+				{putLEfloat(p, float(result.noise[c]));}
+			for (c = 0; c < numChan && !result.gap.empty(); c++, p += 4)
+				{putLEfloat(p, float(result.gap[c]));}
+			break;
+		}
+	}
+}
+
+// write anything pending, leaving the sink empty
+void resultSink::finish()
+{
+	if ((format == SINK_RECORDS) || (format == SINK_COLUMNS))
+	{
+		// header, then tag
+		long tagLength = tag ? (long)strlen(tag) : 0;
+		char head[28];
+		memcpy(head, (format == SINK_RECORDS) ? "TBR2" : "TBC2", 4);
+		putLE32(head + 4, uint32_t(numChan));
+		putLE32(head + 8, uint32_t(numRows));
+		putLE32(head + 12, uint32_t(getRowSize()));
+		putLEdouble(head + 16, start);
+		putLE32(head + 24, uint32_t(tagLength));
+		out.write(head, 28);
+		if (tagLength) {out.write(tag, tagLength);}
+		
+		// records go out as collected, columns are gathered one field at a time
+		if (format == SINK_RECORDS)
+		{
+			if (numRows) {out.write(&rows[0], rows.size());}
+		}
+		else
+		{
+			vector<char> column(4 * numRows + 1);
+			for (long f = 0; f < getRowSize() / 4; f++)
+			{
+				for (long r = 0; r < numRows; r++)
+					{memcpy(&column[4 * r], &rows[r * getRowSize() + 4 * f], 4);}
+				out.write(&column[0], 4 * numRows);
+			}
+		}
+		rows.clear();
+	}
+	out.write(text.data(), text.size());
+	text.clear();
+	numRows = 0;
+	out.flush();
+	showNoise();
+}
+
+// write the mean gap noise spectrum of every burst so far, then start over
+// each bin in dB re +0 dB in a 1 Hz band: one-sided density 2 * power / rate,
+// against the power of a +0 dB tone, AMPLITUDE^2 / 2
+void resultSink::showNoise()
+{
+	if (!noiseOut || !numSpectra) {return;}
+	long numBins = (long)spectrum.size() / numChan;
+	long n = 2 * (numBins - 1);
+	double rate = burst.getRate();
+	double unit = 4.0 / (rate * AMPLITUDE * AMPLITUDE * numSpectra);
+	ostream &noise = *noiseOut;
+	if (tag) {noise << "file\t";}
+	noise << "freq";
+	for (long c = 0; c < numChan; c++) {noise << "\tdB/Hz " << c + 1;}
+	noise << '\n';
+	for (long k = 0; k < numBins; k++)
+	{
+		if (tag) {noise << tag << '\t';}
+		noise << k * rate / n;
+		for (long c = 0; c < numChan; c++)
+			{noise << '\t' << 10.0*log10(unit * spectrum[c * numBins + k]);}
+		noise << '\n';
+	}
+	noise.flush();
+	spectrum.clear();
+	numSpectra = 0;
+}
+
+// synthesize one burst, in 16 bit sample units, up to the end of its interval
+void toneBurst::synth(const burstStep &theStep, vector<double> &y) const
+{
+	long j = 0;		// local loop index, NOT sqrt(-1)
+	long duration = theStep.duration;
+	double factor = theStep.factor;
+	long burstEnd = (duration < interval) ? duration : interval;
+	y.assign(burstEnd, 0.0);
+	
+	// log sweep, frequency rising exponentially from start to end freq
+	if (logSweep)
+	{
+		double rate = log(theStep.actualFreq / theStep.nominalFreq);
+		double scale = 2.0 * M_PI * theStep.nominalFreq * duration / sampleRate / rate;
+		for (j = 0; j < burstEnd; j++)
+		{
+			y[j] = AMPLITUDE * sin(scale * (exp(rate * j / duration) - 1.0));
+		}
+		return;
+	}
+	
+	// multitone, every tone at its own phase, by one inverse transform
+	if (theStep.numTone > 0)
+	{
+		vector< complex<double> > wave(duration);
+		for (long t = 0; t < theStep.numTone; t++)
+		{
+			const burstStep &theTone = tones[theStep.firstTone + t];
+			wave[theTone.numCycle] = polar(1.0, theTone.phase);
+		}
+		fft(wave, true);
+		for (j = 0; j < burstEnd; j++)
+			{y[j] = duration * wave[j].real() * theStep.level;}
+		return;
+	}
+	
+	// raised cosine and second harmonic, normalized to +0 dB amplitude
+	for (j = 0; j < burstEnd; j++)
+	{
+		y[j] = (cos(factor * j) - cos(2.0 * factor * j)) * AMPLITUDE;
+	}
+}
+
+// synthesize one burst interval into a caller-owned buffer
+// 16 bit little-endian stereo, so frames must hold 4 * interval bytes
+// every repetition of the burst is the same, so callers copy it numAvg times
+void toneBurst::render(const burstStep &theStep, char *frames) const
+{
+	long j = 0;		// local loop index, NOT sqrt(-1)
+	short a = 0;
+	
+	// silence after the burst, up to the end of the interval
+	static thread_local vector<double> y;
+	synth(theStep, y);
+	memset(frames, 0, 2 * 2 * interval);
+	for (j = 0; j < (long)y.size(); j++)
+	{
+		// convert to short word
+		a = short(y[j]);
+		
+		// write the same data to both channels, for now
+		putLE16(&frames[4 * j], uint16_t(a));
+		putLE16(&frames[4 * j + 2], uint16_t(a));
+	}
+}
+
+// write a burst to output stream
+// waveform is synthesized once, then written as one block per repetition
+void toneBurst::write(ostream &outfile)
+{
+	vector<char> buffer(2 * 2 * interval);
+	render(step(), &buffer[0]);
+	
+	// iterate over averaging, writing whole intervals
+	for (long i = 0; i < numAvg; i++)
+	{
+		outfile.write(&buffer[0], buffer.size());
+	}
+	return;
+}
+
+// get byte count for sound data in wave file
+// 64 bits, since long runs with heavy averaging pass 4 GB
+uint64_t toneBurst::getSize()
+{
+	// bytes/sample * num channels * (samples/burst * averaging * num bursts + delay)
+	// always assumes 2 byte samples, 2 channel stereo
+	return (2 * 2 * (uint64_t(interval) * numAvg * getCount() + delay));
+}
+
+
+// get sample count per channel for one tone burst, including averaging
+int64_t toneBurst::getSpan() const
+{
+	return (int64_t(interval) * numAvg);
+}
+
+// mix one 64 bit word into a running hash
+static inline uint64_t hashMix(uint64_t h, uint64_t word)
+{
+	h ^= word;
+	h *= 0x9E3779B97F4A7C15ULL;
+	return h ^ (h >> 29);
+}
+
+// fast 64 bit hash of a byte range, four independent lanes of 8 byte words
+// so the multiplies overlap, then the tail, then all lanes folded together
+uint64_t hashBytes(const char *p, size_t count, uint64_t seed)
+{
+	uint64_t h0 = seed ^ 0x243F6A8885A308D3ULL, h1 = seed ^ 0x13198A2E03707344ULL;
+	uint64_t h2 = seed ^ 0xA4093822299F31D0ULL, h3 = seed ^ 0x082EFA98EC4E6C89ULL;
+	size_t j = 0;		// local loop index, NOT sqrt(-1)
+	for (; j + 32 <= count; j += 32)
+	{
+		h0 = hashMix(h0, getLE64(p + j));
+		h1 = hashMix(h1, getLE64(p + j + 8));
+		h2 = hashMix(h2, getLE64(p + j + 16));
+		h3 = hashMix(h3, getLE64(p + j + 24));
+	}
+	for (; j < count; j++) {h0 = hashMix(h0, (unsigned char)p[j]);}
+	uint64_t h = hashMix(hashMix(hashMix(hashMix(count, h0), h1), h2), h3);
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDULL;
+	return h ^ (h >> 33);
+}
+
+// twiddle factors and bit reversed order for one transform size
+struct fftTables
+{
+	vector< complex<double> > twiddle;	// exp(-2 pi i k / size), k < size/2
+	vector<size_t> reverse;	// bit reversed index of each position
+};
+
+// tables for one size, computed the first time that size is used
+// entries of a map never move, so they may be read without holding the lock
+// each thread keeps a pointer per size, and so locks once per size, not per call
+static const fftTables &fftPlan(size_t n)
+{
+	static map<size_t, fftTables> plans;
+	static mutex plansLock;
+	static thread_local const fftTables *known[64] = {0};
+	size_t bits = 0;
+	while ((size_t(1) << bits) < n) {bits++;}
+	if (known[bits]) {return *known[bits];}
+	lock_guard<mutex> guard(plansLock);
+	fftTables &plan = plans[n];
+	if (plan.reverse.size() != n)
+	{
+		size_t i = 0, j = 0;	// local loop indices, NOT sqrt(-1)
+		plan.twiddle.resize(n / 2);
+		for (i = 0; i < n / 2; i++)
+			{plan.twiddle[i] = polar(1.0, -2.0 * M_PI * i / n);}
+		plan.reverse.resize(n);
+		for (i = 1, j = 0; i < n; i++)
+		{
+			size_t bit = n >> 1;
+			for (; j & bit; bit >>= 1) {j ^= bit;}
+			j ^= bit;
+			plan.reverse[i] = j;
+		}
+	}
+	known[bits] = &plan;
+	return plan;
+}
+
+// in-place complex FFT, iterative radix 2
+// size must be a power of two, inverse is scaled by 1/size
+void fft(vector< complex<double> > &data, bool inverse)
+{
+	size_t n = data.size();
+	size_t i = 0, k = 0;	// local loop indices, NOT sqrt(-1)
+	if (n < 2) {return;}
+	const fftTables &plan = fftPlan(n);
+	
+	// reorder into bit reversed sequence
+	for (i = 1; i < n; i++)
+	{
+		if (i < plan.reverse[i]) {swap(data[i], data[plan.reverse[i]]);}
+	}
+	
+	// butterflies, doubling span each pass
+	for (size_t span = 2; span <= n; span <<= 1)
+	{
+		size_t stride = n / span;
+		for (i = 0; i < n; i += span)
+		{
+			for (k = 0; k < span / 2; k++)
+			{
+				complex<double> w = plan.twiddle[k * stride];
+				if (inverse) {w = conj(w);}
+				complex<double> a = data[i + k];
+				complex<double> b = data[i + k + span / 2] * w;
+				data[i + k] = a + b;
+				data[i + k + span / 2] = a - b;
+			}
+		}
+	}
+	if (inverse)
+	{
+		for (i = 0; i < n; i++) {data[i] /= double(n);}
+	}
+}
+
+// FFT of real data, packing even and odd samples as one half size transform
+// then separating them with the twiddle factors of the full size
+void realFft(const vector<double> &data, vector< complex<double> > &spec)
+{
+	size_t n = data.size(), h = n / 2;
+	size_t k = 0;	// local loop index, NOT sqrt(-1)
+	static thread_local vector< complex<double> > z;
+	z.resize(h);
+	for (k = 0; k < h; k++) {z[k] = complex<double>(data[2 * k], data[2 * k + 1]);}
+	fft(z, false);
+	const fftTables &plan = fftPlan(n);
+	spec.resize(h + 1);
+	for (k = 0; k <= h; k++)
+	{
+		complex<double> zk = z[k % h], zn = conj(z[(h - k) % h]);
+		complex<double> even = (zk + zn) / 2.0;
+		complex<double> odd = (zk - zn) / complex<double>(0, 2);
+		complex<double> w = (k < h) ? plan.twiddle[k] : complex<double>(-1, 0);
+		spec[k] = even + w * odd;
+	}
+}
+
+// inverse of realFft, scaled by 1/size
+void realIfft(const vector< complex<double> > &spec, vector<double> &data)
+{
+	size_t h = spec.size() - 1, n = 2 * h;
+	size_t k = 0;	// local loop index, NOT sqrt(-1)
+	const fftTables &plan = fftPlan(n);
+	vector< complex<double> > z(h);
+	for (k = 0; k < h; k++)
+	{
+		complex<double> xk = spec[k], xn = conj(spec[h - k]);
+		complex<double> even = (xk + xn) / 2.0;
+		complex<double> odd = (xk - xn) * conj(plan.twiddle[k]) / 2.0;
+		z[k] = even + complex<double>(0, 1) * odd;
+	}
+	fft(z, true);
+	data.resize(n);
+	for (k = 0; k < h; k++)
+	{
+		data[2 * k] = z[k].real();
+		data[2 * k + 1] = z[k].imag();
+	}
+}
+
+// locate start of first burst by cross-correlation with its known waveform
+// searches up to four burst intervals of frames, first two channels together
+// returns onset in frames, refined to a fraction of a frame, or -1 if not found
+double toneBurst::findOnset(const char *frames, int64_t numFrames) const
+{
+	long j = 0;		// local loop index, NOT sqrt(-1)
+	
+	// same first burst as tbg would generate
+	toneBurst first(*this);
+	first.reset();
+	burstStep theStep = first.step();
+	long refLen = (theStep.duration < interval) ? theStep.duration : interval;
+	if (numFrames > 4 * interval) {numFrames = 4 * interval;}
+	if (numFrames < refLen) {return -1.0;}
+	
+	// transform size covers search range plus burst, without wrap around
+	size_t n = 1;
+	while (n < size_t(numFrames + refLen)) {n <<= 1;}
+	
+	// decode first two channels, packed as real and imaginary parts
+	// since the reference is real, one transform correlates both at once
+	vector<double> chans(numChan * numFrames, 0.0);
+	accumulateAny(type, frames, numFrames, frameSize, numChan,
+		&chans[0], numFrames);
+	const double *chanA = &chans[0];
+	const double *chanB = (numChan > 1) ? chanA + numFrames : chanA;
+	vector< complex<double> > sig(n), ref(n);
+	for (j = 0; j < numFrames; j++) {sig[j] = complex<double>(chanA[j], chanB[j]);}
+	vector<double> y;
+	first.synth(theStep, y);
+	for (j = 0; j < refLen; j++) {ref[j] = y[j];}
+	
+	// correlation is inverse transform of signal times conjugate reference
+	fft(sig, false);
+	fft(ref, false);
+	for (size_t k = 0; k < n; k++) {sig[k] *= conj(ref[k]);}
+	fft(sig, true);
+	
+	// energy of correlation in both channels, either polarity
+	long numLag = long(numFrames - refLen + 1);
+	vector<double> energy(numLag);
+	double peak = 0.0;
+	for (j = 0; j < numLag; j++)
+	{
+		energy[j] = norm(sig[j]);
+		if (energy[j] > peak) {peak = energy[j];}
+	}
+	if (peak <= 0.0) {return -1.0;}
+	
+	// repeated bursts correlate as well as the first one, so find the first
+	// lag within 6 dB of the peak, then the highest lag within one burst of it
+	long start = 0;
+	while (energy[start] < peak / 4.0) {start++;}
+	j = start;
+	for (long k = start; (k < start + refLen) && (k < numLag); k++)
+	{
+		if (energy[k] > energy[j]) {j = k;}
+	}
+	
+	// parabolic fit through the top three points for the fraction
+	double onset = double(j);
+	if ((j > 0) && (j + 1 < numLag))
+	{
+		double y0 = energy[j - 1], y1 = energy[j], y2 = energy[j + 1];
+		double curve = y0 - 2.0 * y1 + y2;
+		if (curve < 0.0) {onset += 0.5 * (y0 - y2) / curve;}
+	}
+	return onset;
+}
+
+// set data members of RIFF chunk
+// remaining byte count covers the format, every chunk head and the data
+void riffChunk::setSize(uint64_t theSize, waveContainer theKind)
+{
+	kind = theKind;
+	dataSize = theSize;
+	switch (kind)
+	{
+		case WAVE_RF64:		// WAVE, ds64, fmt and data chunks
+			memcpy(chunkID, "RF64", 4);	// not a null-terminated string
+			chunkSize = theSize + 72;
+			memcpy(format, "WAVE", 4);
+			break;
+		case WAVE_W64:		// wave GUID, fmt and data chunks
+			memcpy(chunkID, "riff", 4);
+			chunkSize = theSize + 80;
+			memcpy(format, "wave", 4);
+			break;
+		default:			// WAVE, fmt and data chunks
+			memcpy(chunkID, "RIFF", 4);
+			chunkSize = theSize + 36;
+			memcpy(format, "WAVE", 4);
+			break;
+	}
+}
+
+// set data members of fmt chunk
+void fmtChunk::setSize()
+{
+	// assume always 16 bit samples, 2 channel stereo
+	memcpy(chunkID, "fmt ", 4);	// not a null-terminated string
+	chunkSize = 16 ;	// fixed size = 16 for PCM
+	fmtCode = 1;		// code = 1 for PCM
+	numChan = 2;		// number of audio channels
+	sampRate = SAMPLE_RATE;					// sample rate per second
+	byteRate = numChan * sampRate * 2;		// byte rate per second
+	blockAlign = numChan * 2;				// byte count per sample
+	bitsSamp = 16;		// bit count per sample
+	validBits = 16;		// not written for plain PCM
+	chanMask = 0;
+	subFormat = 1;
+}
+
+// set data members of data chunk
+void dataChunk::setSize(uint64_t theSize)
+{
+	memcpy(chunkID, "data", 4);	// not a null-terminated string
+	chunkSize = theSize;
+}
+
+// write chunk ID and size, 8 bytes little-endian
+// or 24 bytes for Wave64, with a GUID and a size counting the head as well
+void chunkHead::write(ostream &out, waveContainer kind)
+{
+	char bytes[24];
+	memcpy(bytes, chunkID, 4);
+	if (kind == WAVE_W64)
+	{
+		memcpy(bytes + 4, isID("riff") ? W64_RIFF_TAIL : W64_TAIL, 12);
+		putLE64(bytes + 16, chunkSize + 24);
+		out.write(bytes, 24);
+		return;
+	}
+	
+	// RF64 riff and data sizes are kept in the ds64 chunk instead
+	bool wide = (kind == WAVE_RF64) && (isID("RF64") || isID("data"));
+	putLE32(bytes + 4, wide ? 0xFFFFFFFF : uint32_t(chunkSize));
+	out.write(bytes, 8);
+}
+
+// write RIFF chunk descriptor, 12 bytes little-endian
+// RF64 follows it with ds64, Wave64 with the rest of the wave GUID
+void riffChunk::write(ostream &out)
+{
+	chunkHead::write(out, kind);
+	out.write(format, 4);
+	if (kind == WAVE_W64) {out.write(W64_TAIL, 12);}
+	if (kind == WAVE_RF64)
+	{
+		// riff size, data size, sample count, then an empty table
+		char bytes[36];
+		memcpy(bytes, "ds64", 4);
+		putLE32(bytes + 4, 28);
+		putLE64(bytes + 8, chunkSize);
+		putLE64(bytes + 16, dataSize);
+		putLE64(bytes + 24, dataSize / 4);	// always 16 bit stereo
+		putLE32(bytes + 32, 0);
+		out.write(bytes, 36);
+	}
+}
+
+// write fmt chunk, 24 bytes little-endian for plain PCM
+void fmtChunk::write(ostream &out, waveContainer kind)
+{
+	char bytes[16];
+	chunkHead::write(out, kind);
+	putLE16(bytes, fmtCode);
+	putLE16(bytes + 2, numChan);
+	putLE32(bytes + 4, sampRate);
+	putLE32(bytes + 8, byteRate);
+	putLE16(bytes + 12, blockAlign);
+	putLE16(bytes + 14, bitsSamp);
+	out.write(bytes, 16);
+}
+
+// read chunk ID and size, 8 bytes little-endian
+// or 24 bytes for Wave64, whose size counts the head as well
+bool chunkHead::read(istream &in, waveContainer kind)
+{
+	char bytes[24];
+	if (kind != WAVE_W64)
+	{
+		if (!in.read(bytes, 8)) {return false;}
+		memcpy(chunkID, bytes, 4);
+		chunkSize = getLE32(bytes + 4);
+		return true;
+	}
+	if (!in.read(bytes, 24)) {return false;}
+	memcpy(chunkID, bytes, 4);
+	chunkSize = getLE64(bytes + 16);
+	if (chunkSize < 24) {return false;}
+	chunkSize -= 24;
+	return true;
+}
+
+// read RIFF chunk descriptor, 12 bytes little-endian
+// RF64 looks the same, with its sizes found later in the ds64 chunk
+// Wave64 has a riff GUID, 64 bit size and wave GUID, 40 bytes in all
+bool riffChunk::read(istream &in)
+{
+	char bytes[40];
+	kind = WAVE_RIFF;
+	dataSize = 0;
+	if (!in.read(bytes, 12)) {return false;}
+	memcpy(chunkID, bytes, 4);
+	chunkSize = getLE32(bytes + 4);
+	memcpy(format, bytes + 8, 4);
+	if (isID("riff") && (memcmp(bytes + 4, W64_RIFF_TAIL, 8) == 0))
+	{
+		if (!in.read(bytes + 12, 28)) {return false;}
+		kind = WAVE_W64;
+		chunkSize = getLE64(bytes + 16) - 24;
+		memcpy(format, bytes + 24, 4);
+		return (memcmp(bytes + 4, W64_RIFF_TAIL, 12) == 0) &&
+			(memcmp(format, "wave", 4) == 0) && (memcmp(bytes + 28, W64_TAIL, 12) == 0);
+	}
+	if (isID("RF64")) {kind = WAVE_RF64;}
+	return (isID("RIFF") || isID("RF64")) && (memcmp(format, "WAVE", 4) == 0);
+}
+
+// read fmt chunk body, after its head has been read
+// accepts plain PCM, IEEE float, and WAVE_FORMAT_EXTENSIBLE
+bool fmtChunk::read(istream &in, chunkHead &head)
+{
+	// copy head, then read known fields and skip the rest, with padding
+	(chunkHead &)*this = head;
+	if (chunkSize < 16) {return false;}
+	char bytes[40] = {0};
+	streamsize count = (chunkSize < 40) ? streamsize(chunkSize) : 40;
+	if (!in.read(bytes, count)) {return false;}
+	in.ignore(streamsize(chunkSize) - count);
+	if (!in) {return false;}
+	
+	fmtCode = getLE16(bytes);
+	numChan = getLE16(bytes + 2);
+	sampRate = getLE32(bytes + 4);
+	byteRate = getLE32(bytes + 8);
+	blockAlign = getLE16(bytes + 12);
+	bitsSamp = getLE16(bytes + 14);
+	validBits = bitsSamp;
+	chanMask = 0;
+	subFormat = fmtCode;
+	
+	// extensible format keeps the real format code in its GUID
+	if ((fmtCode == 0xFFFE) && (chunkSize >= 40))
+	{
+		validBits = getLE16(bytes + 18);
+		chanMask = getLE32(bytes + 20);
+		subFormat = getLE16(bytes + 24);
+	}
+	return true;
+}
+
+// decode format code and sample size into a sample encoding
+sampleType fmtChunk::getType()
+{
+	if (subFormat == 1)		// integer PCM
+	{
+		if (bitsSamp == 16) {return SAMPLE_INT16;}
+		if (bitsSamp == 24) {return SAMPLE_INT24;}
+		if (bitsSamp == 32) {return SAMPLE_INT32;}
+	}
+	if ((subFormat == 3) && (bitsSamp == 32)) {return SAMPLE_FLOAT32;}
+	return SAMPLE_UNKNOWN;
+}
+
+// walk chunks up to the start of sound data
+// fmt must come before data, anything else is skipped
+// RIFF, RF64 and Wave64 differ only in their heads, padding and ds64 chunk
+bool waveHeader::read(istream &in)
+{
+	bool haveFmt = false;
+	uint64_t wideData = 0;		// RF64 data size, from ds64 chunk
+	if (!riff.read(in)) {return false;}
+	waveContainer kind = riff.getKind();
+	uint64_t headSize = (kind == WAVE_W64) ? 24 : 8;
+	uint64_t align = (kind == WAVE_W64) ? 8 : 2;
+	dataOffset = (kind == WAVE_W64) ? 40 : 12;
+	
+	chunkHead head;
+	while (head.read(in, kind))
+	{
+		// chunks are padded to an even byte count, or 8 bytes for Wave64
+		uint64_t size = head.getSize();
+		uint64_t pad = (align - size % align) % align;
+		dataOffset += headSize;
+		if (head.isID("data"))
+		{
+			if (wideData && (size == 0xFFFFFFFF)) {head.setWide(wideData);}
+			(chunkHead &)data = head;
+			return haveFmt;
+		}
+		if (head.isID("fmt "))
+		{
+			if (!fmt.read(in, head)) {return false;}
+			haveFmt = true;
+			in.ignore(streamsize(pad));
+		}
+		else if ((kind == WAVE_RF64) && head.isID("ds64") && (size >= 16))
+		{
+			// riff and data sizes say 0xFFFFFFFF, the real ones are here
+			char bytes[16];
+			if (!in.read(bytes, 16)) {return false;}
+			riff.setWide(getLE64(bytes));
+			wideData = getLE64(bytes + 8);
+			in.ignore(streamsize(size - 16 + pad));
+		}
+		else {in.ignore(streamsize(size + pad));}
+		if (!in) {return false;}
+		dataOffset += size + pad;
+	}
+	return false;
+}
+
+// show all header chunks on console
+void waveHeader::dump()
+{
+	riff.dump();
+	fmt.dump();
+	data.dump();
+}
+
+// show chunk details on console
+void chunkHead::dump()
+{
+	// convert character array to null-terminated string
+    char s[5] = "ABCD";
+    memcpy(s, chunkID, 4);
+	
+	// show on console
+    cout << "   chunkID:\t" << s << endl;
+	cout << " chunkSize:\t" << chunkSize << endl;
+}
+
+// show RIFF chunk details on console
+void riffChunk::dump()
+{
+	chunkHead::dump();	// invoke method in superclass
+
+	// convert character array to null-terminated string
+    char s[5] = "ABCD";
+    memcpy(s, format, 4);
+	
+	// show on console
+    cout << "    format:\t" << s << endl;
+}
+
+// show fmt chunk details on console
+void fmtChunk::dump()
+{
+	chunkHead::dump();	// invoke method in superclass
+	
+	// show remaining data members on console
+	cout <<  "   fmtCode:\t" << fmtCode
+		<< "\n   numChan:\t" << numChan
+		<< "\n  sampRate:\t" << sampRate
+		<< "\n  byteRate:\t" << byteRate
+		<< "\nblockAlign:\t" << blockAlign
+		<< "\n  bitsSamp:\t" << bitsSamp << endl;
+	
+	// show extensible fields only if present
+	if (fmtCode == 0xFFFE)
+	{
+		cout << " validBits:\t" << validBits
+			<< "\n  chanMask:\t" << chanMask
+			<< "\n subFormat:\t" << subFormat << endl;
+	}
+}
+
+// show data chunk details on console
+void dataChunk::dump()
+{
+	chunkHead::dump();	// invoke method in superclass
+}
+
+// default constructor for mapped file
+waveMap::waveMap()
+{
+	base = 0;
+	length = 0;
+#ifdef _WIN32
+	hFile = INVALID_HANDLE_VALUE;
+	hMap = 0;
+#endif
+}
+
+// destructor unmaps file, if still mapped
+waveMap::~waveMap()
+{
+	close();
+}
+
+// map whole file into memory, read only
+bool waveMap::open(const char *fname)
+{
+	close();
+#ifdef _WIN32
+	hFile = CreateFileA(fname, GENERIC_READ, FILE_SHARE_READ, 0,
+		OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+	if (hFile == INVALID_HANDLE_VALUE) {return false;}
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(hFile, &fileSize) || (fileSize.QuadPart == 0))
+		{close(); return false;}
+	hMap = CreateFileMappingA(hFile, 0, PAGE_READONLY, 0, 0, 0);
+	if (!hMap) {close(); return false;}
+	base = (const char *)MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, 0);
+	if (!base) {close(); return false;}
+	length = (size_t)fileSize.QuadPart;
+#else
+	int fd = ::open(fname, O_RDONLY);
+	if (fd < 0) {return false;}
+	struct stat info;
+	if ((fstat(fd, &info) != 0) || (info.st_size == 0))
+		{::close(fd); return false;}
+	void *addr = mmap(0, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);	// mapping stays valid after file is closed
+	if (addr == MAP_FAILED) {return false;}
+	
+	// samples are read front to back, so ask for read-ahead
+	madvise(addr, info.st_size, MADV_SEQUENTIAL);
+	base = (const char *)addr;
+	length = (size_t)info.st_size;
+#endif
+	return true;
+}
+
+// release mapping, safe to call more than once
+void waveMap::close()
+{
+#ifdef _WIN32
+	if (base) {UnmapViewOfFile(base);}
+	if (hMap) {CloseHandle(hMap);}
+	if (hFile != INVALID_HANDLE_VALUE) {CloseHandle(hFile);}
+	hFile = INVALID_HANDLE_VALUE;
+	hMap = 0;
+#else
+	if (base) {munmap((void *)base, length);}
+#endif
+	base = 0;
+	length = 0;
+}
+
+// output map is unused until created
+waveOutMap::waveOutMap()
+{
+	base = 0;
+	length = 0;
+#ifdef _WIN32
+	hFile = INVALID_HANDLE_VALUE;
+	hMap = 0;
+#endif
+}
+
+// destructor unmaps file
+waveOutMap::~waveOutMap()
+{
+	close();
+}
+
+// make a new file of theSize bytes, all zero, and map it for writing
+// disk space is reserved first, since a full disk would otherwise
+// only show up as a fault when a page is written
+bool waveOutMap::create(const char *fname, size_t theSize)
+{
+	close();
+	if (theSize == 0) {return false;}
+#ifdef _WIN32
+	hFile = CreateFileA(fname, GENERIC_READ | GENERIC_WRITE, 0, 0,
+		CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+	if (hFile == INVALID_HANDLE_VALUE) {return false;}
+	uint64_t wide = theSize;
+	hMap = CreateFileMappingA(hFile, 0, PAGE_READWRITE, DWORD(wide >> 32),
+		DWORD(wide & 0xFFFFFFFF), 0);
+	if (!hMap) {close(); return false;}
+	base = (char *)MapViewOfFile(hMap, FILE_MAP_WRITE, 0, 0, 0);
+	if (!base) {close(); return false;}
+#else
+	int fd = ::open(fname, O_RDWR | O_CREAT | O_TRUNC, 0666);
+	if (fd < 0) {return false;}
+#ifdef __APPLE__
+	fstore_t store = {F_ALLOCATEALL, F_PEOFPOSMODE, 0, off_t(theSize), 0};
+	bool room = (fcntl(fd, F_PREALLOCATE, &store) != -1) &&
+		(ftruncate(fd, off_t(theSize)) == 0);
+#else
+	bool room = (posix_fallocate(fd, 0, off_t(theSize)) == 0);
+#endif
+	if (!room) {::close(fd); return false;}
+	void *addr = mmap(0, theSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);	// mapping stays valid after file is closed
+	if (addr == MAP_FAILED) {return false;}
+	base = (char *)addr;
+#endif
+	length = theSize;
+	return true;
+}
+
+// write changed pages back to disk, then release mapping
+// safe to call more than once, false if any step failed
+bool waveOutMap::close()
+{
+	bool good = true;
+#ifdef _WIN32
+	if (base) {good = (FlushViewOfFile(base, 0) != 0);}
+	if (base && (hFile != INVALID_HANDLE_VALUE))
+		{good = (FlushFileBuffers(hFile) != 0) && good;}
+	if (base) {good = (UnmapViewOfFile(base) != 0) && good;}
+	if (hMap) {CloseHandle(hMap);}
+	if (hFile != INVALID_HANDLE_VALUE) {CloseHandle(hFile);}
+	hFile = INVALID_HANDLE_VALUE;
+	hMap = 0;
+#else
+	if (base) {good = (msync(base, length, MS_SYNC) == 0);}
+	if (base) {good = (munmap(base, length) == 0) && good;}
+#endif
+	base = 0;
+	length = 0;
+	return good;
+}
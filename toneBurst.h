@@ -10,23 +10,201 @@
 // on an Apple MacBook Pro with Intel Core Duo processor.
 // Also built (with trivial changes) and tested under MSVC++ 6.0.
 // While it is meant to be easily ported to other environments,
-// it should NOT be considered portable, in that it relies heavily
-// on specific data sizes and struct packing to match the .WAV format.
-// It is meant for Intel byte ordering, and will almost certainly fail
-// if built for Motorola or PPC processors.
+// wave file headers and samples are read and written field by field,
+// in little-endian order, so do not depend on struct packing or on
+// the byte ordering of the host processor.
 //
 // This code is placed in the public domain for the benefit and
 // entertaiment of audio enthusiasts and hobbyists.  Any and all uses
 // are encouraged, but not supported by the author.
 //----------------------------------------------------------------------------
 
+#ifndef TONEBURST_H
+#define TONEBURST_H
+
+// standard files needed by the declarations below
+#include <iostream>
+#include <complex>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <stdint.h>
+
 // define constant values used in generation and analysis
 #define SAMPLE_RATE 44100	// number of samples per second
 #define INTERVAL 22050		// number of samples per burst
 #define BURST_LENGTH 100	// minimum length, in samples
 #define AMPLITUDE 12000.0		// nominal +0 dB signal level
+#define SWEEP_START 100.0	// default freq sweep, 100 steps per decade
+#define SWEEP_STOP 10000.0
+#define SWEEP_STEPS 201
+#define POLAR_FREQ 1000.0	// default polar plot, every 5 degrees
+#define POLAR_STEPS 72
+#define MULTITONE_SIZE 8192	// samples per multitone window, a power of two
+#define SWEEP_SECONDS 4.0	// default log sweep length
+#define GATE_LENGTH 1024	// default log sweep impulse response gate, in samples
+#define MAX_HARMONIC 10		// highest harmonic analyzed with each tone burst
+#define TRIM_FRACTION 0.25	// share of repetitions farthest from the median, dropped
+#define WELCH_LENGTH 1024	// noise spectrum frame, in samples, a power of two
 // #define M_PI 3.1415926535898	// uncomment this line for MSVC++ 6.0
 
+// sample encodings understood by the analyzer
+enum sampleType
+{
+	SAMPLE_UNKNOWN,		// not supported
+	SAMPLE_INT16,		// 16 bit signed integer
+	SAMPLE_INT24,		// 24 bit signed integer, packed in 3 bytes
+	SAMPLE_INT32,		// 32 bit signed integer
+	SAMPLE_FLOAT32		// 32 bit IEEE float, +/-1.0 full scale
+};
+
+// little-endian field access, independent of host byte order and packing
+inline uint16_t getLE16(const char *p)
+{
+	const unsigned char *u = (const unsigned char *)p;
+	return uint16_t(u[0] | (u[1] << 8));
+}
+
+inline uint32_t getLE32(const char *p)
+{
+	const unsigned char *u = (const unsigned char *)p;
+	return uint32_t(u[0]) | (uint32_t(u[1]) << 8)
+		| (uint32_t(u[2]) << 16) | (uint32_t(u[3]) << 24);
+}
+
+inline uint64_t getLE64(const char *p)
+{
+	return uint64_t(getLE32(p)) | (uint64_t(getLE32(p + 4)) << 32);
+}
+
+inline void putLE16(char *p, uint16_t value)
+{
+	p[0] = char(value & 0xFF);
+	p[1] = char(value >> 8);
+}
+
+inline void putLE32(char *p, uint32_t value)
+{
+	putLE16(p, uint16_t(value & 0xFFFF));
+	putLE16(p + 2, uint16_t(value >> 16));
+}
+
+inline void putLE64(char *p, uint64_t value)
+{
+	putLE32(p, uint32_t(value & 0xFFFFFFFF));
+	putLE32(p + 4, uint32_t(value >> 32));
+}
+
+inline void putLEfloat(char *p, float value)
+{
+	uint32_t bits = 0;
+	memcpy(&bits, &value, 4);
+	putLE32(p, bits);
+}
+
+inline double getLEdouble(const char *p)
+{
+	uint64_t bits = getLE64(p);
+	double value = 0.0;
+	memcpy(&value, &bits, 8);
+	return value;
+}
+
+inline void putLEdouble(char *p, double value)
+{
+	uint64_t bits = 0;
+	memcpy(&bits, &value, 8);
+	putLE64(p, bits);
+}
+
+// containers for wave files, all holding the same fmt and data chunks
+enum waveContainer
+{
+	WAVE_RIFF,		// standard RIFF, sizes up to 4 GB
+	WAVE_RF64,		// EBU RF64, 64 bit sizes kept in a ds64 chunk
+	WAVE_W64		// Sony Wave64, GUID chunk IDs and 64 bit sizes
+};
+
+// Wave64 chunk IDs are GUIDs, whose first 4 bytes match the RIFF chunk ID
+// every chunk but the outer riff one shares the same last 12 bytes
+static const char W64_RIFF_TAIL[] = "\x2E\x91\xCF\x11\xA5\xD6\x28\xDB\x04\xC1\x00\x00";
+static const char W64_TAIL[] = "\xF3\xAC\xD3\x11\x8C\xD1\x00\xC0\x4F\x8E\xDB\x8A";
+
+// arithmetic used by the single tone matched filter
+enum precisionMode
+{
+	PRECISION_DOUBLE,	// double rows and sums, for calibration
+	PRECISION_FLOAT,	// float rows, float sums with running error terms
+	PRECISION_FIXED		// int32 rows, fixed point phasors, int64 sums
+};
+
+// how the repetitions of a single tone burst are combined
+enum averageMode
+{
+	AVERAGE_SUM,		// summed sample by sample, then filtered once, fastest
+	AVERAGE_MEAN,		// filtered one by one, mean of their phasors
+	AVERAGE_MEDIAN,		// filtered one by one, median real and imaginary parts
+	AVERAGE_TRIM		// filtered one by one, mean of those nearest the median
+};
+
+// formats for analysis results
+enum sinkFormat
+{
+	SINK_TEXT,		// tab separated text, as shown on console
+	SINK_CSV,		// comma separated text
+	SINK_RECORDS,	// binary, one fixed size record per burst
+	SINK_COLUMNS	// binary, each field for all bursts together
+};
+
+// details for one step of a frequency plan
+// fully determines where and how one burst is analyzed
+struct burstStep
+{
+	long numCycle;		// number of cycles per burst
+	long duration;		// number of samples within burst
+	double nominalFreq;	// nominal tone burst frequency
+	double actualFreq;	// actual tone burst frequency
+	double factor;		// frequency in sample-based units
+	int64_t offset;		// samples from start of data to start of burst, 64 bits
+	double phase;		// tone phase at start of burst, zero unless multitone
+	double level;		// tone amplitude, AMPLITUDE unless multitone
+	long firstTone;		// multitone burst only, index of its first tone
+	long numTone;		// multitone burst only, number of tones, else zero
+};
+
+// matched filter results for one burst, normalized to +0 dB
+// one entry per channel, or per channel of each tone for a multitone burst
+// harmonics 2 and up follow the same layout, harmonic-major, if analyzed
+// reduced precision adds a bound on each response's error, same units
+// averaging one repetition at a time adds the standard error of each response
+// a gap noise spectrum adds each channel's noise at the burst frequency, as
+// the matched filter would find it, then each channel's spectrum in turn
+struct burstResult
+{
+	std::vector< std::complex<double> > resp;	// response
+	std::vector< std::complex<double> > bkg;	// background
+	std::vector< std::complex<double> > harm;	// harmonics, or empty
+	std::vector<double> err;	// error bound each channel, or empty
+	std::vector<double> noise;	// standard error each channel, or empty
+	std::vector<double> gap;	// gap noise each channel, then spectra, or empty
+};
+
+// identity of one burst's results, for reusing them across runs
+// two hashes, of the samples the matched filter reads, and of every
+// parameter which changes what it finds
+struct cacheKey
+{
+	uint64_t content;	// samples read for this burst
+	uint64_t params;	// burst and analysis parameters
+	bool operator<(const cacheKey &other) const
+	{
+		return (content < other.content) ||
+			((content == other.content) && (params < other.params));
+	}
+};
+
+class resultSink;
+
 // tone burst object, does not get written to disk
 // so it's not sensitive to byte order and packing
 class toneBurst
@@ -34,95 +212,316 @@ class toneBurst
 private:
 	// data members
 	long sampleRate;	// number of samples per second
-	long duration;		// number of samples within burst
 	long interval;		// number of samples per burst
 	long burstMin;		// minimum number of samples within burst
-	long numBurst;		// number of bursts
-	long burstCount;	// index to count bursts
-	long numCycle;		// number of cycles per burst
-	double nominalFreq;	// nominal tone burst frequency
-	double actualFreq;	// actual tone burst frequency
-	double stopFreq;	// sweep end frequency
-	double freqIncr;	// freq sweep increment
-	double factor;		// frequency in sample-based units
+	long burstIndex;	// index of current burst in table
 	bool sweep;			// true if freq sweep, false if polar
+	bool logSweep;		// true if one log sweep instead of tone bursts
+	sampleType type;	// encoding of each sample
+	long numChan;		// number of channels per frame
+	long frameSize;		// byte count per frame, all channels
+	std::vector<burstStep> table;	// every burst in order, built by reset()
+	std::vector<burstStep> tones;	// every tone of multitone bursts, in order
 
 public:
-	double startFreq;	// sweep start frequency
+	double startFreq;	// sweep start frequency, or polar frequency
+	double stopFreq;	// sweep end frequency
+	long numBurst;		// number of bursts in sweep or polar plot
+	long perDecade;		// if nonzero, sweep steps per decade instead
+	long numTones;		// if more than one, tones sharing each burst
+	long sweepLen;		// log sweep length in samples
+	long gateLen;		// log sweep impulse response gate, in samples
+	long numHarm;		// if more than one, highest harmonic analyzed
+	precisionMode precision;	// matched filter arithmetic, double by default
+	averageMode average;	// how repetitions are combined, summed by default
+	long welchLen;		// if nonzero, frame length for gap noise spectra
+	std::vector<double> freqList;	// if not empty, measured in this order
 	long delay;			// offset to start of first burst
 	long numAvg;		// number of bursts to average over
 
 private:
 	// method members
-	void calc();		// calculate next frequency
+	burstStep calc(double theFreq, long index) const;	// details for one burst
+	void nominals(std::vector<double> &freqs) const;	// plan frequencies
+	void toneBins(std::vector<double> &freqs,
+		std::vector<long> &bins) const;	// distinct multitone bins
+	void planTones();	// group tones into multitone bursts
+	void planSweep();	// one log sweep, analyzed at every output bin
+	void synth(const burstStep &theStep,
+		std::vector<double> &y) const;	// waveform for one burst
+	void analyzeTones(const burstStep &step, const char *frames,
+		burstResult &result) const;		// analyze multitone burst
+	void analyzeSweep(const burstStep &step, const char *frames,
+		burstResult &result) const;		// deconvolve log sweep
+	void analyzeReduced(const burstStep &step, const char *frames,
+		burstResult &result) const;		// float or fixed point
+	void analyzeGap(const burstStep &step, const char *frames,
+		burstResult &result) const;		// noise spectrum between bursts
 
 public:
 	void showDetail();	// show details at one frequency
-	void showSetup();	// show general setup info
-	void read(std::ifstream &infile);	// read tone burst from disk
-	void write(std::ofstream &outfile);	// write tone burst to disk
-	void reset();		// reset burst object
+	void showDetail(const burstStep &step, std::ostream &out = std::cout) const;
+	void showResult(const burstResult &result,
+		std::ostream &out = std::cout) const;	// show analysis results
+	void getColumns(const burstResult &result,
+		std::vector<double> &cols) const;	// results as shown, unformatted
+	void showSetup(std::ostream &out = std::cout) const;	// general setup info
+	void showHeading(std::ostream &out = std::cout,
+		char sep = '\t') const;	// column headings
+	void read(const char *&frames, resultSink &sink);	// analyze in memory
+	void analyze(const burstStep &step, const char *frames,
+		burstResult &result) const;		// analyze any burst, thread safe
+	long analyzeFrames(const char *frames, int64_t numFrames,
+		burstResult *results) const;	// every complete burst, thread safe
+	cacheKey getKey(const burstStep &step,
+		const char *frames) const;	// identify results, thread safe
+	void setFormat(sampleType theType, long theChan);	// set input encoding
+	void setRate(long theRate);	// set sample rate, keeping times the same
+	double findOnset(const char *frames, int64_t numFrames) const;	// find first burst
+	long getFrameSize() const {return frameSize;}
+	long getChannels() const {return numChan;}
+	long getHarmonics() const;	// highest harmonic analyzed, or zero
+	precisionMode getPrecision() const;	// arithmetic actually used
+	averageMode getAverage() const;	// combining actually used
+	long getWelch() const;	// gap noise spectrum frame length, or zero
+	long getRate() const {return sampleRate;}
+	burstStep step();	// get details at current frequency
+	void plan(std::vector<burstStep> &steps);	// get all steps in order
+	void write(std::ostream &outfile);	// write tone burst to disk or memory
+	void render(const burstStep &step, char *frames) const;	// one interval
+	void reset();		// build burst table, and start at its first burst
+	long getCount() const;	// number of bursts in plan
+	const burstStep &getTone(long index) const {return tones[index];}
+	bool loadList(const char *fname);	// read frequency list from text file
 	bool next();		// increment frequency, return false if done
 	bool good();		// return false if done
-	long getSize();		// get byte count for generated tone bursts
+	uint64_t getSize();	// get byte count for generated tone bursts
+	int64_t getSpan() const;	// get sample count for one averaged tone burst
 	toneBurst();		// default constructor
 	void init(bool theSweep);  // calculate internal values
+	void initLog(long theLen);	// one log sweep of theLen samples instead
+};
+
+// destination for analysis results, one row per burst in plan order
+// text rows are written as they arrive, but never flushed per row
+// csv rows are formatted into a buffer, and written in large blocks
+// binary rows are collected, and written as one block when finished
+//
+// each binary block is little-endian, with a 28 byte header, then the tag
+//   "TBR2" for records or "TBC2" for columns, 4 bytes
+//   number of channels, number of rows, bytes per row, each uint32
+//   start of first burst in frames, float64, exact past 2^24 frames
+//   (version 1 had a 24 byte header, with the start as float32)
+//   tag length in bytes, uint32, then the tag itself
+// each row holds numCyc and duration (int32), nomFreq and actFreq (float32)
+// then magnitude, phase and background magnitude for each channel (float32)
+// then, if harmonics are analyzed, THD and each harmonic 2 and up for each
+// channel, as ratios to the fundamental (float32)
+// then, for float or fixed point precision, each channel's error bound
+// then, if repetitions are averaged one at a time, each channel's standard error
+// then, with gap noise spectra, each channel's noise at the burst frequency
+//
+// the noise spectrum of a capture, if asked for, is always text: frequency,
+// then each channel's mean gap noise in dB re +0 dB in a 1 Hz band
+// records hold one row after another, columns hold one field after another
+class resultSink
+{
+private:
+	// data members
+	const toneBurst &burst;	// formats text rows
+	sinkFormat format;		// how rows are written
+	std::ostream &out;		// where rows are written
+	const char *tag;		// first column of every row, or null
+	long numChan;			// number of channels per row
+	long numRows;			// number of rows collected
+	double start;			// start of first burst, in frames
+	std::string text;		// pending csv text
+	std::vector<char> rows;	// pending binary rows
+	std::vector<double> cols;	// result columns for one row
+	std::ostream *noiseOut;	// where the noise spectrum goes, or null
+	std::vector<double> spectrum;	// sum of gap noise spectra, each channel
+	long numSpectra;		// number of bursts summed into spectrum
+	
+	// method members
+	void putRow(const burstStep &step, const burstResult &result);
+	void showNoise();		// write mean noise spectrum, if any
+
+public:
+	// method members
+	void showHeading(const char *tagHead = 0);	// column headings, text only
+	void setOnset(double onset);	// first burst found, binary header only
+	void put(const burstStep &step, const burstResult &result);	// one row
+	void finish();			// write anything pending
+	void setNoise(std::ostream *theOut) {noiseOut = theOut;}	// spectrum too
+	bool isText() const {return (format == SINK_TEXT) || (format == SINK_CSV);}
+	long getRowSize() const {return 16 + (12 + 4 * burst.getHarmonics() +
+		((burst.getPrecision() != PRECISION_DOUBLE) ? 4 : 0) +
+		((burst.getAverage() != AVERAGE_SUM) ? 4 : 0) +
+		(burst.getWelch() ? 4 : 0)) * numChan;}
+	resultSink(const toneBurst &theBurst, sinkFormat theFormat,
+		std::ostream &theOut, const char *theTag = 0);
+};
+
+// fast 64 bit hash of a byte range, continuing from seed
+// not cryptographic, but enough to tell captures and parameters apart
+uint64_t hashBytes(const char *p, size_t count, uint64_t seed);
+
+// in-place complex FFT, size must be a power of two
+// twiddle factors for each size are computed once and shared by all threads,
+// then found without locking
+void fft(std::vector< std::complex<double> > &data, bool inverse);
+
+// FFT of real data, size a power of two, giving size/2 + 1 bins
+// done as a complex FFT of half the size
+void realFft(const std::vector<double> &data,
+	std::vector< std::complex<double> > &spec);
+void realIfft(const std::vector< std::complex<double> > &spec,
+	std::vector<double> &data);		// inverse, scaled by 1/size
+
+// read-only view of a whole file mapped into memory
+// sound data is analyzed in place, without copying
+class waveMap
+{
+private:
+	// data members
+	const char *base;	// start of mapped file, or null
+	size_t length;		// byte count of mapped file
+#ifdef _WIN32
+	void *hFile;		// file handle
+	void *hMap;			// file mapping handle
+#endif
+
+public:
+	// method members
+	bool open(const char *fname);	// map file, return false if failed
+	void close();		// unmap file
+	const char *data() {return base;}
+	size_t size() {return length;}
+	waveMap();			// default constructor
+	~waveMap();			// destructor unmaps file
+};
+
+// writable view of a new file of known size, mapped into memory
+// bursts are synthesized straight into place, from many threads at once
+class waveOutMap
+{
+private:
+	// data members
+	char *base;			// start of mapped file, or null
+	size_t length;		// byte count of mapped file
+#ifdef _WIN32
+	void *hFile;		// file handle
+	void *hMap;			// file mapping handle
+#endif
+
+public:
+	// method members
+	bool create(const char *fname, size_t theSize);	// make and map file
+	bool close();		// flush and unmap file, return false if failed
+	char *data() {return base;}
+	size_t size() {return length;}
+	waveOutMap();		// default constructor
+	~waveOutMap();		// destructor unmaps file
 };
 
 // container for ID and size
-// must be exactly 8 bytes, in order as shown
+// exactly 8 bytes on disk, in order as shown, or 24 bytes for Wave64
+// where the ID is a GUID and the size is 64 bits, counting the head too
+// fields are fixed width, and always read and written little-endian
 class chunkHead
 {
 protected:
 	// data members
 	char chunkID[4];	// 4 characters, not null-terminated
-	long chunkSize;		// remaining byte count in this file
+	uint64_t chunkSize;	// remaining byte count in this chunk, after its head
 
 	// method member
 	void dump();
+	
+public:
+	bool read(std::istream &in,
+		waveContainer kind = WAVE_RIFF);	// read from disk, false if failed
+	void write(std::ostream &out, waveContainer kind = WAVE_RIFF);	// write to disk
+	bool isID(const char *theID) {return memcmp(chunkID, theID, 4) == 0;}
+	uint64_t getSize() {return chunkSize;}
+	void setWide(uint64_t theSize) {chunkSize = theSize;}	// size from RF64 ds64
 };
 
-// RIFF chunk descriptor, exactly as written out to disk
-// must be exactly 12 bytes, in order as shown
-class riffChunk: chunkHead
+// RIFF chunk descriptor
+// exactly 12 bytes on disk, in order as shown
+// RF64 adds a 36 byte ds64 chunk, Wave64 is 40 bytes with GUIDs
+class riffChunk: public chunkHead
 {
 private:
-	// data member
+	// data members
 	char format[4];		// 4 characters, not null-terminated
+	waveContainer kind;	// RIFF, RF64 or Wave64
+	uint64_t dataSize;	// RF64 only, data size written to ds64 chunk
 	
 public:
 	// method members
 	void dump();
-	void setSize(long theSize);
+	void setSize(uint64_t theSize, waveContainer theKind = WAVE_RIFF);
+	bool read(std::istream &in);	// also checks for RIFF, RF64 or Wave64
+	void write(std::ostream &out);	// RF64 also writes its ds64 chunk
+	waveContainer getKind() {return kind;}
 };
 
-// FMT sub-chunk, exactly as written out to disk
-// must be exactly 24 bytes, in order as shown
-class fmtChunk: chunkHead
+// FMT sub-chunk
+// 24 bytes on disk for plain PCM, in order as shown
+// 48 bytes for WAVE_FORMAT_EXTENSIBLE, which adds the fields below
+class fmtChunk: public chunkHead
 {
 private:
 	// data members
-	short fmtCode;		// data format code
-	short numChan;		// number of audio channels
-	long sampRate;		// sample rate per second
-	long byteRate;		// byte rate per second
-	short blockAlign;	// byte count per sample
-	short bitsSamp;		// bits count per sample
+	uint16_t fmtCode;	// data format code
+	uint16_t numChan;	// number of audio channels
+	uint32_t sampRate;	// sample rate per second
+	uint32_t byteRate;	// byte rate per second
+	uint16_t blockAlign;	// byte count per sample
+	uint16_t bitsSamp;	// bits count per sample
+	uint16_t validBits;	// extensible only, bits actually used
+	uint32_t chanMask;	// extensible only, speaker positions
+	uint16_t subFormat;	// extensible only, leading code of format GUID
 	
 public:
 	// method members
 	void dump();
 	void setSize();
+	bool read(std::istream &in, chunkHead &head);	// read body after head
+	void write(std::ostream &out, waveContainer kind = WAVE_RIFF);
+	sampleType getType();	// decode format, or SAMPLE_UNKNOWN
+	long getChannels() {return numChan;}
+	long getRate() {return sampRate;}
+	long getBlockAlign() {return blockAlign;}
 };
 
-// DATA sub-chunk, exactly as written out to disk
-// must be exactly 8 bytes, plus data which follows
-class dataChunk: chunkHead
+// DATA sub-chunk
+// exactly 8 bytes on disk, plus data which follows
+class dataChunk: public chunkHead
 {
 	// actual sound data starts here, but we won't try to load it into memory
 	
 public:
 	// method members
 	void dump();
-	void setSize(long theSize);
+	void setSize(uint64_t theSize);
+};
+
+// wave file header, found by walking chunks in whatever order they appear
+// chunks other than fmt and data (LIST, fact, etc.) are skipped
+class waveHeader
+{
+public:
+	// data members
+	riffChunk riff;
+	fmtChunk fmt;
+	dataChunk data;
+	uint64_t dataOffset;	// byte count from start of file to first sample
+	
+	// method members
+	bool read(std::istream &in);	// stops at start of sound data
+	void dump();
 };
+
+#endif	// TONEBURST_H